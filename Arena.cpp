@@ -0,0 +1,186 @@
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include "Arena.hpp"
+#include "Consts.hpp"
+
+// Every allocation is aligned like malloc() would align it
+static const size_t kArenaAlign = 16;
+
+static size_t alignSize(size_t size)
+{
+	return (size + kArenaAlign - 1) & ~(kArenaAlign - 1);
+}
+
+Arena::Arena() : _blocks(NULL), _mallocCount(0)
+{
+}
+
+Arena::Arena(const Arena &) : _blocks(NULL), _mallocCount(0)
+{
+}
+
+Arena &Arena::operator=(const Arena &src)
+{
+	if (this != &src)
+		release();
+	return *this;
+}
+
+Arena::~Arena()
+{
+	release();
+}
+
+char *Arena::blockData(Block *block)
+{
+	return reinterpret_cast<char *>(block) + alignSize(sizeof(Block));
+}
+
+Arena::Block *Arena::newBlock(size_t size)
+{
+	Block *block = static_cast<Block *>(::operator new(alignSize(sizeof(Block)) + size));
+	block->next = _blocks;
+	block->size = size;
+	block->used = 0;
+	_blocks = block;
+	_mallocCount++;
+	return block;
+}
+
+void *Arena::allocate(size_t size)
+{
+	size = alignSize(size);
+	if (_blocks == NULL || _blocks->size - _blocks->used < size)
+		newBlock(std::max(size, kArenaBlockSize));
+	char *ptr = blockData(_blocks) + _blocks->used;
+	_blocks->used += size;
+	return ptr;
+}
+
+// Frees everything but the first regular block, which is kept for the next round
+void Arena::reset()
+{
+	Block *kept = NULL;
+	while (_blocks != NULL)
+	{
+		Block *block = _blocks;
+		_blocks = block->next;
+		if (block->next == NULL && block->size == kArenaBlockSize)
+			kept = block;
+		else
+			::operator delete(block);
+	}
+	if (kept != NULL)
+		kept->used = 0;
+	_blocks = kept;
+	_mallocCount = 0;
+}
+
+void Arena::release()
+{
+	while (_blocks != NULL)
+	{
+		Block *block = _blocks;
+		_blocks = block->next;
+		::operator delete(block);
+	}
+	_mallocCount = 0;
+}
+
+size_t Arena::getMallocCount() const
+{
+	return _mallocCount;
+}
+
+size_t Arena::getBytesUsed() const
+{
+	size_t used = 0;
+	for (Block *block = _blocks; block != NULL; block = block->next)
+		used += block->used;
+	return used;
+}
+
+ArenaString::ArenaString(Arena &arena) : _arena(&arena),
+										 _data(NULL),
+										 _size(0),
+										 _capacity(0)
+{
+}
+
+ArenaString::ArenaString(const ArenaString &src) : _arena(src._arena),
+												   _data(NULL),
+												   _size(0),
+												   _capacity(0)
+{
+	append(src._data, src._size);
+}
+
+ArenaString::~ArenaString()
+{
+	// The bytes belong to the arena
+}
+
+// Moves to a larger chunk of the arena, the old one is reclaimed by the next reset
+void ArenaString::reserve(size_t capacity)
+{
+	if (capacity <= _capacity)
+		return;
+	capacity = std::max(capacity, std::max(_capacity * 2, kArenaStringCapacity));
+	char *data = static_cast<char *>(_arena->allocate(capacity));
+	if (_size > 0)
+		std::memcpy(data, _data, _size);
+	_data = data;
+	_capacity = capacity;
+}
+
+ArenaString &ArenaString::append(const char *data, size_t length)
+{
+	reserve(_size + length);
+	if (length > 0)
+		std::memcpy(_data + _size, data, length);
+	_size += length;
+	return *this;
+}
+
+ArenaString &ArenaString::operator<<(const char *str)
+{
+	return append(str, std::strlen(str));
+}
+
+ArenaString &ArenaString::operator<<(const std::string &str)
+{
+	return append(str.data(), str.size());
+}
+
+ArenaString &ArenaString::operator<<(unsigned long value)
+{
+	char digits[24];
+	size_t pos = sizeof(digits);
+	do
+	{
+		digits[--pos] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+	return append(digits + pos, sizeof(digits) - pos);
+}
+
+ArenaString &ArenaString::operator<<(long value)
+{
+	if (value < 0)
+	{
+		append("-", 1);
+		return *this << static_cast<unsigned long>(-(value + 1)) + 1;
+	}
+	return *this << static_cast<unsigned long>(value);
+}
+
+const char *ArenaString::data() const
+{
+	return _data;
+}
+
+size_t ArenaString::size() const
+{
+	return _size;
+}
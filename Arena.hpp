@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+/**
+ * Bump allocator for the short-lived data a connection builds while
+ * answering requests. Memory comes out of fixed-size blocks and is
+ * released all at once by reset(), which keeps one block so a warm
+ * keep-alive connection stops calling malloc for it.
+ */
+class Arena
+{
+public:
+	Arena();
+	// A copy starts empty, blocks are never shared
+	Arena(const Arena &src);
+	Arena &operator=(const Arena &src);
+	~Arena();
+
+	void *allocate(size_t size);
+	void reset();
+	// Blocks malloc'ed since the last reset
+	size_t getMallocCount() const;
+	size_t getBytesUsed() const;
+
+private:
+	struct Block
+	{
+		Block *next;
+		size_t size;
+		size_t used;
+	};
+
+	Block *_blocks; // the block being filled first
+	size_t _mallocCount;
+
+	static char *blockData(Block *block);
+	Block *newBlock(size_t size);
+	void release();
+};
+
+// Append-only string stored in an Arena, for building response headers
+class ArenaString
+{
+public:
+	explicit ArenaString(Arena &arena);
+	ArenaString(const ArenaString &src);
+	~ArenaString();
+
+	ArenaString &append(const char *data, size_t length);
+	ArenaString &operator<<(const char *str);
+	ArenaString &operator<<(const std::string &str);
+	ArenaString &operator<<(unsigned long value);
+	ArenaString &operator<<(long value);
+
+	const char *data() const;
+	size_t size() const;
+
+private:
+	Arena *_arena;
+	char *_data;
+	size_t _size;
+	size_t _capacity;
+
+	ArenaString &operator=(const ArenaString &src);
+	void reserve(size_t capacity);
+};
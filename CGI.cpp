@@ -5,6 +5,7 @@
 #include <cerrno>
 #include <iostream>
 #include <stdexcept>
+#include <map>
 #include <vector>
 #include "CGI.hpp"
 #include "ProcUtils.hpp"
@@ -110,9 +111,10 @@ void CGI::setCgiBodySentBytes(int bytes)
 	_cgiBodySentBytes = bytes;
 }
 
-char **CGI::createEnv(const HttpRequest &request, const std::string &scriptPath,
-					  const std::string &localPort, const std::string &remoteHost,
-					  const std::string &uploadDir) const
+// "NAME=value" strings of the CGI environment, also sent as the FastCGI params
+std::vector<std::string> CGI::createEnvStrings(const HttpRequest &request, const std::string &scriptPath,
+											   const std::string &localPort, const std::string &remoteHost,
+											   const std::string &uploadDir) const
 {
 	std::vector<std::string> env_strings;
 	if (!uploadDir.empty())
@@ -136,8 +138,24 @@ char **CGI::createEnv(const HttpRequest &request, const std::string &scriptPath,
 	env_strings.push_back("REMOTE_ADDR=" + remoteHost);
 	env_strings.push_back("REMOTE_HOST=" + remoteHost);
 
+	// Repeated header lines are folded into one variable: the last line wins,
+	// Transfer-Encoding values are joined and Connection is the one the server acts on
+	std::map<std::string, std::string> headers;
+	for (size_t h = 0; h < request.getHeaderCount(); ++h)
+	{
+		std::string name = request.getHeaderName(h);
+		std::map<std::string, std::string>::iterator it = headers.find(name);
+		if (it != headers.end() && name == "transfer-encoding")
+			it->second += ", " + request.getHeaderValue(h);
+		else
+			headers[name] = request.getHeaderValue(h);
+	}
+	if (request.hasHeader(H_CONNECTION))
+		headers["connection"] = request.getHeader(H_CONNECTION);
+	else
+		headers.erase("connection");
+
 	// Headers as environment variables
-	const std::map<std::string, std::string> &headers = request.getHeaders();
 	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
 	{
 		std::string header_name = it->first;
@@ -157,15 +175,17 @@ char **CGI::createEnv(const HttpRequest &request, const std::string &scriptPath,
 	{
 		// Convert body length to string using the helper function
 		env_strings.push_back("CONTENT_LENGTH=" + numberToString(request.getBody().length()));
-		try
-		{
-			const std::string &content_type = request.getHeaderValue("content-type");
-			env_strings.push_back("CONTENT_TYPE=" + content_type);
-		}
-		catch (const std::exception &e)
-		{
-		}
+		if (request.hasHeader(H_CONTENT_TYPE))
+			env_strings.push_back("CONTENT_TYPE=" + request.getHeader(H_CONTENT_TYPE));
 	}
+	return env_strings;
+}
+
+char **CGI::createEnv(const HttpRequest &request, const std::string &scriptPath,
+					  const std::string &localPort, const std::string &remoteHost,
+					  const std::string &uploadDir) const
+{
+	std::vector<std::string> env_strings = createEnvStrings(request, scriptPath, localPort, remoteHost, uploadDir);
 
 	// Allocate space for environment array (null-terminated)
 	char **envp = NULL;
@@ -260,6 +280,7 @@ void CGI::start(const HttpRequest &request, const std::string &cgiPath, const st
 	}
 	else if (pid == 0) // Child process
 	{
+		signal(SIGPIPE, SIG_DFL); // ignored in the server, restore it for the script
 		closeFd(pipeIn[1]);	 // Close unused write end of pipeIn
 		closeFd(pipeOut[0]); // Close unused read end of pipeOut
 		if (dup2(pipeIn[0], STDIN_FILENO) == -1 || dup2(pipeOut[1], STDOUT_FILENO) == -1)
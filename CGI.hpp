@@ -1,6 +1,7 @@
 #pragma once
 #include <unistd.h>
 #include <string>
+#include <vector>
 
 class HttpRequest;
 
@@ -29,6 +30,10 @@ public:
 	void start(const HttpRequest &request, const std::string &cgiPath, const std::string &scriptPath,
 	          const std::string &localPort, const std::string &remoteHost, const std::string &uploadDir);
 
+	std::vector<std::string> createEnvStrings(const HttpRequest &request, const std::string &scriptPath,
+											  const std::string &localPort, const std::string &remoteHost,
+											  const std::string &uploadDir) const;
+
 	char **createEnv(const HttpRequest &request, const std::string &scriptPath,
 	               const std::string &localPort, const std::string &remoteHost,
 				   const std::string &uploadDir) const;
@@ -1,6 +1,10 @@
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <strings.h> // for strcasecmp
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -16,6 +20,9 @@
 #include "StringUtils.hpp"
 #include "FileUtils.hpp"
 #include "CGI.hpp"
+#include "Arena.hpp"
+#include "HeaderCache.hpp"
+#include "HttpUtils.hpp"
 
 Connection::Connection(int fd,
 					   const std::string &port,
@@ -29,11 +36,20 @@ Connection::Connection(int fd,
 										 _remotePort(remotePort),
 										 _remoteHost(remoteHost),
 										 _lastActivityTime(time(0)),
+										 _timerDeadline(0),
 										 _serverConfig(NULL),
 										 _locationConfig(NULL),
+										 _routedHost(),
+										 _routedServer(NULL),
 										 _cgi(),
+										 _fastCgiFd(-1),
+										 _fastCgiId(0),
 										 _request(ptr->getClientHeaderBufferSize(), ptr->getClientMaxBodySize()),
 										 _response(),
+										 _cgiOutput(),
+										 _pipelined(),
+										 _arena(),
+										 _encodingHeaders(NULL),
 										 _keepAlive(kDefaultKeepAlive)
 
 {
@@ -46,11 +62,20 @@ Connection::Connection(const Connection &connection) : _fd(connection._fd),
 													   _remotePort(connection._remotePort),
 													   _remoteHost(connection._remoteHost),
 													   _lastActivityTime(connection._lastActivityTime),
+													   _timerDeadline(connection._timerDeadline),
 													   _serverConfig(connection._serverConfig),
 													   _locationConfig(connection._locationConfig),
+													   _routedHost(connection._routedHost),
+													   _routedServer(connection._routedServer),
 													   _cgi(connection._cgi),
+													   _fastCgiFd(connection._fastCgiFd),
+													   _fastCgiId(connection._fastCgiId),
 													   _request(connection._request),
 													   _response(connection._response),
+													   _cgiOutput(connection._cgiOutput),
+													   _pipelined(connection._pipelined),
+													   _arena(connection._arena),
+													   _encodingHeaders(connection._encodingHeaders),
 													   _keepAlive(connection._keepAlive)
 {
 }
@@ -66,11 +91,20 @@ Connection &Connection::operator=(const Connection &connection)
 		_remotePort = connection._remotePort;
 		_remoteHost = connection._remoteHost;
 		_lastActivityTime = connection._lastActivityTime;
+		_timerDeadline = connection._timerDeadline;
 		_serverConfig = connection._serverConfig;
 		_locationConfig = connection._locationConfig;
+		_routedHost = connection._routedHost;
+		_routedServer = connection._routedServer;
 		_cgi = connection._cgi;
+		_fastCgiFd = connection._fastCgiFd;
+		_fastCgiId = connection._fastCgiId;
 		_request = connection._request;
 		_response = connection._response;
+		_cgiOutput = connection._cgiOutput;
+		_pipelined = connection._pipelined;
+		_arena = connection._arena;
+		_encodingHeaders = connection._encodingHeaders;
 		_keepAlive = connection._keepAlive;
 	}
 	return *this;
@@ -78,9 +112,42 @@ Connection &Connection::operator=(const Connection &connection)
 
 Connection::~Connection()
 {
+	abortFastCgi();
 	_cgi.reset();
 }
 
+void Connection::attach(int fd,
+						const std::string &port,
+						const std::string &host,
+						const std::string &remotePort,
+						const std::string &remoteHost)
+{
+	// assign() reuses the capacity left by the previous client
+	_fd = fd;
+	_port.assign(port);
+	_host.assign(host);
+	_remotePort.assign(remotePort);
+	_remoteHost.assign(remoteHost);
+	_lastActivityTime = time(0);
+	_timerDeadline = 0;
+	_routedServer = NULL; // the new client may have come in on another address
+}
+
+// Releases everything tied to the client but keeps the buffers for the next one
+void Connection::detach()
+{
+	reset(); // also stops a CGI process still running
+	_response.clear();
+	if (_pipelined.capacity() > kPooledBufferLimit)
+		std::string().swap(_pipelined);
+	else
+		_pipelined.clear();
+	_arena.reset();
+	_routedServer = NULL;
+	_fd = -1;
+	_timerDeadline = 0;
+}
+
 int Connection::getFd() const
 {
 	return _fd;
@@ -146,6 +213,16 @@ void Connection::updateActivityTime()
 	_lastActivityTime = time(0);
 }
 
+time_t Connection::getTimerDeadline() const
+{
+	return _timerDeadline;
+}
+
+void Connection::setTimerDeadline(time_t deadline)
+{
+	_timerDeadline = deadline;
+}
+
 Server *Connection::getServerConfig() const
 {
 	return _serverConfig;
@@ -161,14 +238,34 @@ Location *Connection::getLocationConfig() const
 	return _locationConfig;
 }
 
-const std::string &Connection::getResponse() const
+ssize_t Connection::sendResponse(int sockFd)
 {
-	return _response.getResponse();
+	ssize_t nbytes = _response.sendResponse(sockFd);
+	// Queued headers point into the arena, it can only be recycled once everything is sent
+	if (_response.isComplete())
+	{
+		if (DEBUG)
+			std::cout << "Arena of fd " << sockFd << ": " << _arena.getBytesUsed() << " bytes, "
+					  << _arena.getMallocCount() << " block allocations" << std::endl;
+		_arena.reset();
+	}
+	return nbytes;
+}
+
+bool Connection::isResponseComplete() const
+{
+	return _response.isComplete();
+}
+
+// True until the request is fully parsed (or rejected)
+bool Connection::isReadingRequest() const
+{
+	return _request.getState() < S_DONE;
 }
 
-void Connection::eraseResponse(int nbytes)
+RequestState Connection::getRequestState() const
 {
-	_response.eraseResponse(nbytes);
+	return _request.getState();
 }
 
 pid_t Connection::getCgiPid() const
@@ -214,12 +311,55 @@ bool Connection::isAllowdMethod(const std::string &method, const std::map<std::s
 	return false;
 }
 
-RequestState Connection::handleClientRecv(const std::string &raw)
+/**
+ * Feeds bytes received from the client to the request parser.
+ * Each request is answered as soon as it is complete and the responses are
+ * queued in order, so the pipelined requests of one read go out in one batch.
+ * Parsing stops at a CGI request, the bytes that follow it are kept until
+ * its response is queued (see resumePipeline()), and after a response that
+ * closes the connection.
+ */
+RequestState Connection::handleClientRecv(const char *data, size_t len)
+{
+	updateActivityTime();
+	size_t offset = 0;
+	while (true)
+	{
+		RequestState state = handleRequest(data + offset, len - offset, offset);
+		if (state == S_CGI_PROCESSING)
+		{
+			_pipelined.append(data + offset, len - offset);
+			return state;
+		}
+		if (state != S_DONE || !_keepAlive)
+			return state;
+		// Response queued, the next request starts right after this one
+		reset();
+		if (offset == len)
+			return _request.getState();
+	}
+}
+
+// Parses the requests that arrived behind a CGI request once its response is queued
+RequestState Connection::resumePipeline()
+{
+	reset();
+	std::string pending;
+	pending.swap(_pipelined);
+	return handleClientRecv(pending.data(), pending.size());
+}
+
+bool Connection::isCgiRunning() const
+{
+	return _cgi.getOutFd() != -1 || _fastCgiFd != -1;
+}
+
+// Parses one request from data, offset is advanced by the bytes it used
+RequestState Connection::handleRequest(const char *data, size_t len, size_t &offset)
 {
 	try
 	{
-		updateActivityTime();
-		_request.parseRequest(raw);
+		offset += _request.parseRequest(data, len);
 
 		if (_request.getState() == S_DONE)
 		{
@@ -275,7 +415,7 @@ RequestState Connection::handleClientRecv(const std::string &raw)
 
 bool Connection::processCgiHeaders(const std::string &cgiData, std::string &statusCode,
 								   std::map<std::string, std::string> &cgiHeaders,
-								   std::string &body)
+								   size_t &bodyStart)
 {
 	// Look for the end of headers
 	size_t headerEnd = cgiData.find("\r\n\r\n");
@@ -285,9 +425,9 @@ bool Connection::processCgiHeaders(const std::string &cgiData, std::string &stat
 		return false;		// Headers not complete
 	}
 
-	// Split into headers and body
+	// Split into headers and body, the body is left in place
 	std::string headers = cgiData.substr(0, headerEnd);
-	body = cgiData.substr(headerEnd + 4); // +4 to skip "\r\n\r\n"
+	bodyStart = headerEnd + 4; // +4 to skip "\r\n\r\n"
 
 	// Process headers
 	std::istringstream headerStream(headers);
@@ -351,16 +491,14 @@ bool Connection::processCgiHeaders(const std::string &cgiData, std::string &stat
 	return true;
 }
 
-std::string Connection::buildHttpResponse(const std::string &statusCode,
+void Connection::appendHttpResponseHeader(const std::string &statusCode,
 										  const std::map<std::string, std::string> &headers,
-										  const std::string &body)
+										  size_t bodyLength)
 {
-	std::ostringstream oss;
+	ArenaString oss(_arena);
 
 	// Build the HTTP response
-	oss << "HTTP/1.1 " << statusCode << " " << kStatusCodes.find(statusCode)->second << "\r\n";
-	oss << "Server: webserver/1.0\r\n";
-	oss << "Date: " << getCurrentTime() << "\r\n";
+	oss << getStatusPrefix(statusCode) << getDateHeader();
 
 	// Add CGI headers
 	for (std::map<std::string, std::string>::const_iterator it = headers.begin();
@@ -369,7 +507,7 @@ std::string Connection::buildHttpResponse(const std::string &statusCode,
 		oss << it->first << ": " << it->second << "\r\n";
 	}
 
-	oss << "Content-Length: " << body.length() << "\r\n";
+	oss << "Content-Length: " << bodyLength << "\r\n";
 
 	// Add Connection header
 	oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
@@ -377,10 +515,35 @@ std::string Connection::buildHttpResponse(const std::string &statusCode,
 	// End headers
 	oss << "\r\n";
 
-	// Add body
-	oss << body;
+	_response.appendResponseView(oss.data(), oss.size());
+}
 
-	return oss.str();
+// Header of a CGI response, the name is matched without case
+static std::map<std::string, std::string>::iterator findCgiHeader(std::map<std::string, std::string> &headers,
+																  const char *name)
+{
+	for (std::map<std::string, std::string>::iterator it = headers.begin(); it != headers.end(); ++it)
+	{
+		if (strcasecmp(it->first.c_str(), name) == 0)
+			return it;
+	}
+	return headers.end();
+}
+
+// gzip of the CGI body, unless the script encoded it already
+void Connection::gzipCgiOutput(std::map<std::string, std::string> &headers)
+{
+	std::map<std::string, std::string>::iterator type = findCgiHeader(headers, "Content-Type");
+	if (type == headers.end() || findCgiHeader(headers, "Content-Encoding") != headers.end() ||
+		!isGzipCandidate(type->second, _cgiOutput.length()))
+		return;
+	std::map<std::string, std::string>::iterator vary = findCgiHeader(headers, "Vary");
+	if (vary == headers.end())
+		headers["Vary"] = "Accept-Encoding";
+	else if (vary->second != "*")
+		vary->second += ", Accept-Encoding";
+	if (gzipBody(_cgiOutput))
+		headers["Content-Encoding"] = "gzip";
 }
 
 RequestState Connection::finalizeCgiRecv(int fd)
@@ -392,7 +555,7 @@ RequestState Connection::finalizeCgiRecv(int fd)
 			std::cout << "CGI process completed output on fd " << fd << std::endl;
 
 		// If no data was ever received, generate an error
-		if (_response.getResponse().empty())
+		if (_cgiOutput.empty())
 		{
 			_keepAlive = false;
 			_response.generateErrorResponse("502"); // Bad Gateway
@@ -400,20 +563,23 @@ RequestState Connection::finalizeCgiRecv(int fd)
 		}
 
 		// Now that we have all the data, process the CGI response
-		std::string responseData = _response.getResponse();
 		std::string statusCode;
 		std::map<std::string, std::string> cgiHeaders;
-		std::string body;
+		size_t bodyStart = 0;
 
 		// Process headers if we have a complete response
-		if (!processCgiHeaders(responseData, statusCode, cgiHeaders, body))
+		if (!processCgiHeaders(_cgiOutput, statusCode, cgiHeaders, bodyStart))
 		{
 			// No headers section found or missing Content-Type
 			_keepAlive = false;
 			_response.generateErrorResponse("502");
 			return S_ERROR;
 		}
-		_response.setResponse(buildHttpResponse(statusCode, cgiHeaders, body));
+		// The body is queued as is after the header, without copying it
+		_cgiOutput.erase(0, bodyStart);
+		gzipCgiOutput(cgiHeaders);
+		appendHttpResponseHeader(statusCode, cgiHeaders, _cgiOutput.length());
+		_response.appendResponseData(_cgiOutput);
 
 		return S_DONE;
 }
@@ -442,15 +608,14 @@ RequestState Connection::handleCgiRecv(int fd)
 		updateActivityTime();
 
 		// Check if adding the new data would exceed the client_max_body_size limit
-		if (_response.getResponse().length() + nbytes > _webserver->getClientMaxBodySize())
+		if (_cgiOutput.length() + nbytes > _webserver->getClientMaxBodySize())
 		{
 			_keepAlive = false;
 			_response.generateErrorResponse("413"); // Request Entity Too Large
 			return S_ERROR;
 		}
 
-		buf[nbytes] = '\0';
-		_response.appendResponse(std::string(buf, nbytes));
+		_cgiOutput.append(buf, nbytes);
 
 		return S_CGI_PROCESSING; // Continue processing
 	}
@@ -493,31 +658,97 @@ RequestState Connection::handleCgiSend(int fd)
 	return S_CGI_PROCESSING;
 }
 
+void Connection::buildFastCgiParams(std::vector<std::string> &params) const
+{
+	params = _cgi.createEnvStrings(_request, resolvePath(_locationConfig->getRoot(), _request.getTarget()),
+								   _port, _remoteHost, _locationConfig->getUploadDirectory());
+}
+
+// Only a POST body is passed on, like to a CGI process
+const std::string &Connection::getFastCgiStdin() const
+{
+	static const std::string empty;
+	if (_request.getMethod() != "POST")
+		return empty;
+	return _request.getBody();
+}
+
+void Connection::setFastCgiRequest(int fd, uint16_t requestId)
+{
+	_fastCgiFd = fd;
+	_fastCgiId = requestId;
+}
+
+// FCGI_STDOUT data of the request, false once it outgrew client_max_body_size and a 413 is queued
+bool Connection::appendFastCgiOutput(const char *data, size_t len)
+{
+	updateActivityTime();
+	if (_cgiOutput.length() + len > _webserver->getClientMaxBodySize())
+	{
+		_fastCgiFd = -1;
+		_keepAlive = false;
+		_response.generateErrorResponse("413"); // Request Entity Too Large
+		return false;
+	}
+	_cgiOutput.append(data, len);
+	return true;
+}
+
+// FCGI_END_REQUEST came, the output is parsed like the one of a CGI process
+void Connection::finalizeFastCgi()
+{
+	_fastCgiFd = -1;
+	finalizeCgiRecv(-1);
+}
+
+// The backend can't be reached, closed its socket or refused the request
+void Connection::failFastCgi()
+{
+	_fastCgiFd = -1;
+	_keepAlive = false;
+	_response.generateErrorResponse("502"); // Bad Gateway
+}
+
 void Connection::reset()
 {
-	_request = HttpRequest(_webserver->getClientHeaderBufferSize(), _webserver->getClientMaxBodySize());
-	_response = HttpResponse();
+	// The response queue is left alone: it may still hold the answers to earlier pipelined requests
+	_request.reset();
+	std::string().swap(_cgiOutput); // don't keep a large CGI output allocated
+	_keepAlive = kDefaultKeepAlive;
 	_serverConfig = NULL;
 	_locationConfig = NULL;
+	abortFastCgi();
 	_cgi.reset();
 }
 
+// The backend may still answer, the pool drops what comes for the request
+void Connection::abortFastCgi()
+{
+	if (_fastCgiFd == -1)
+		return;
+	_webserver->getFastCgiPool().abort(_fastCgiFd, _fastCgiId);
+	_fastCgiFd = -1;
+}
+
 /**
  * Sets the server and location configuration for the current request.
- * Attempts to match a server block in the following order:
+ * The Host is matched without its port and case insensitively, in the
+ * following order:
  *
  * 1. Exact match: <address>:<port> "server_name"
  *    Example: 127.0.0.1:8081 "example.com"
  *
- * 2. Address match with default server name: <address>:<port> ""
- *    Example: 127.0.0.1:8081 ""
+ * 2. Wildcard match, longest suffix first: <address>:<port> "*.server_name"
+ *    Example: 127.0.0.1:8081 "*.example.com" for "www.example.com"
  *
- * 3. Address match with default host: 0.0.0.0:<port> "server_name"
- *    Example: 0.0.0.0:8081 "example.com"
+ * 3. Address match with default server name: <address>:<port> ""
+ *    Example: 127.0.0.1:8081 ""
  *
- * 4. Default server (fallback): 0.0.0.0:<port> ""
- *    Example: 0.0.0.0:8081 ""
+ * 4. The same three steps with the default host: 0.0.0.0:<port>
+ *    Example: 0.0.0.0:8081 "example.com", then 0.0.0.0:8081 ""
  *
+ * The server found is kept for the next requests of a keep-alive
+ * connection that send the same Host.
  * After finding a matching server block, searches for a matching
  * location block based on the request URI.
  */
@@ -528,41 +759,13 @@ void Connection::setServerAndLocation()
 	// because the location cannot be set without the server
 	if (_serverConfig != NULL)
 		return;
-	const std::map<ServerKey, Server *> &servers = _webserver->getServers();
-	ServerKey key(_port, _host, _request.getHostName());
-	std::map<ServerKey, Server *>::const_iterator it = servers.find(key);
-	if (it != servers.end())
-	{
-		_serverConfig = it->second;
-	}
-	if (_serverConfig == NULL)
-	{
-		key.server_name = kDefaultServerName;
-		it = servers.find(key);
-		if (it != servers.end())
-		{
-			_serverConfig = it->second;
-		}
-	}
-	if (_serverConfig == NULL)
-	{
-		key.host = kDefaultHost;
-		key.server_name = _request.getHostName();
-		it = servers.find(key);
-		if (it != servers.end())
-		{
-			_serverConfig = it->second;
-		}
-	}
-	if (_serverConfig == NULL)
+	if (_routedServer != NULL && _request.isHeaderEqual(H_HOST, _routedHost.c_str()))
+		_serverConfig = _routedServer;
+	else
 	{
-		key.host = kDefaultHost;
-		key.server_name = kDefaultServerName;
-		it = servers.find(key);
-		if (it != servers.end())
-		{
-			_serverConfig = it->second;
-		}
+		_routedHost = _request.getHostName();
+		_serverConfig = _webserver->getVirtualHosts().find(_port, _host, _routedHost);
+		_routedServer = _serverConfig;
 	}
 	if (_serverConfig == NULL)
 	{
@@ -610,31 +813,27 @@ void Connection::generateReturnDirectiveResponse(const std::string &status, cons
 										"<hr><center>webserver/1.0</center>\n"
 										"</body>\n"
 										"</html>\n";
-		std::ostringstream oss;
-		oss << "HTTP/1.1 " << status << " " << statusText << "\r\n";
-		oss << "Server: webserver/1.0\r\n";
-		oss << "Date: " << getCurrentTime() << "\r\n";
+		ArenaString oss(_arena);
+		oss << getStatusPrefix(status) << getDateHeader();
 		oss << "Content-Type: text/html\r\n";
 		oss << "Content-Length: " << body.length() << "\r\n";
 		oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
 		oss << "Location: " << text << "\r\n";
 		oss << "\r\n"
 			<< body;
-		_response.setResponse(oss.str());
+		_response.appendResponseView(oss.data(), oss.size());
 	}
 	else
 	{
 		std::string body = text;
-		std::ostringstream oss;
-		oss << "HTTP/1.1 " << status << " " << statusText << "\r\n";
-		oss << "Server: webserver/1.0\r\n";
-		oss << "Date: " << getCurrentTime() << "\r\n";
+		ArenaString oss(_arena);
+		oss << getStatusPrefix(status) << getDateHeader();
 		oss << "Content-Type: application/octet-stream\r\n";
 		oss << "Content-Length: " << body.length() << "\r\n";
 		oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
 		oss << "\r\n"
 			<< body;
-		_response.setResponse(oss.str());
+		_response.appendResponseView(oss.data(), oss.size());
 	}
 }
 
@@ -792,39 +991,173 @@ std::string Connection::generateAutoIndex(const std::string& path, const std::st
 	return oss.str();
 }
 
-void Connection::generateResponse()
+// Resolves a static path to what will be served, without caching
+void Connection::openStaticFile(const std::string &path, OpenFileInfo &info) const
 {
-	std::string body;
-	std::string fullPath(resolvePath(_locationConfig->getRoot(), _request.getTarget()));
-	if (fullPath[fullPath.length() - 1] == '/')
+	info.path = path;
+	info.fd = -1;
+	info.size = 0;
+	info.mtime = 0;
+	info.inode = 0;
+	info.isDirectory = false;
+	info.error = NULL;
+	if (path[path.length() - 1] == '/')
 	{
-		std::set<std::string> indexes = _locationConfig->getIndex();
+		const std::set<std::string> &indexes = _locationConfig->getIndex();
 		for (std::set<std::string>::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
 		{
-			std::string indexFile = *it;
-			if (isFile(fullPath + indexFile))
+			if (isFile(path + *it))
 			{
-				fullPath += indexFile;
+				info.path += *it;
 				break;
 			}
 		}
 	}
-	if (isDirectory(fullPath))
+	struct stat st;
+	if (stat(info.path.c_str(), &st) == -1 || (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)))
+	{
+		info.error = "404";
+		return;
+	}
+	info.isDirectory = S_ISDIR(st.st_mode);
+	// CGI scripts are run, not read
+	if (info.isDirectory || !getCgiPath(info.path).empty())
+	{
+		info.mtime = st.st_mtime;
+		info.inode = st.st_ino;
+		return;
+	}
+	info.fd = open(info.path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (info.fd == -1 || fstat(info.fd, &st) == -1)
+	{
+		closeFd(info.fd);
+		info.fd = -1;
+		info.error = "403";
+		return;
+	}
+	info.size = st.st_size;
+	info.mtime = st.st_mtime;
+	info.inode = st.st_ino;
+}
+
+// Goes through the open file cache when it is on, cached tells who owns the descriptor
+const OpenFileInfo *Connection::findStaticFile(const std::string &path, OpenFileInfo &resolved, bool &cached)
+{
+	OpenFileCache &cache = _webserver->getOpenFileCache();
+	time_t now = time(NULL);
+	const OpenFileInfo *file = cache.isEnabled() ? cache.find(path, now) : NULL;
+	cached = (file != NULL);
+	if (file != NULL)
+		return file;
+	openStaticFile(path, resolved);
+	if (cache.isEnabled())
+	{
+		const OpenFileInfo *entry = cache.insert(path, resolved, now);
+		if (entry != NULL)
+		{
+			cached = true; // the cache owns the descriptor now
+			return entry;
+		}
+	}
+	return &resolved;
+}
+
+// gzip_static: file.br or file.gz is sent in place of file when the client accepts its coding.
+// Looking the siblings up can evict file from the open file cache, so it is looked up again
+const OpenFileInfo *Connection::findPrecompressed(const std::string &requestPath, const OpenFileInfo *file,
+												  OpenFileInfo &resolved, bool &cached)
+{
+	static const char *const codings[] = {"br", "gzip"};
+	static const char *const suffixes[] = {".br", ".gz"};
+	static const char *const headers[] = {"Content-Encoding: br\r\nVary: Accept-Encoding\r\n",
+										  "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n"};
+
+	// The response depends on Accept-Encoding even when the file itself is sent
+	_encodingHeaders = "Vary: Accept-Encoding\r\n";
+	if (_request.getMethod() != "GET" || !_request.hasHeader(H_ACCEPT_ENCODING))
+		return file;
+	std::string acceptEncoding = _request.getHeader(H_ACCEPT_ENCODING);
+	std::string path = file->path;
+	bool looked = false;
+	for (size_t i = 0; i < sizeof(codings) / sizeof(codings[0]); ++i)
+	{
+		if (!acceptsEncoding(acceptEncoding, codings[i]))
+			continue;
+		looked = true;
+		bool variantCached;
+		const OpenFileInfo *variant = findStaticFile(path + suffixes[i], resolved, variantCached);
+		if (variant->error == NULL && variant->fd != -1)
+		{
+			if (!cached)
+				closeFd(file->fd);
+			cached = variantCached;
+			_encodingHeaders = headers[i];
+			return variant;
+		}
+	}
+	if (looked && cached)
+	{
+		file = findStaticFile(requestPath, resolved, cached);
+		if (file->error != NULL)
+			throw std::runtime_error(file->error);
+		if (file->fd == -1)
+			throw std::runtime_error("404"); // replaced by a directory meanwhile
+	}
+	return file;
+}
+
+void Connection::generateResponse()
+{
+	if (_locationConfig->isFastcgiPassSet())
+	{
+		// The backend resolves the script itself, WebServer::startFastCgi() sends the request
+		_request.setState(S_CGI_PROCESSING);
+		return;
+	}
+	std::string fullPath(resolvePath(_locationConfig->getRoot(), _request.getTarget()));
+	std::string requestPath(fullPath);
+	OpenFileInfo resolved;
+	bool cached;
+	const OpenFileInfo *file = findStaticFile(fullPath, resolved, cached);
+	if (file->error != NULL)
+		throw std::runtime_error(file->error);
+	fullPath = file->path;
+	_encodingHeaders = NULL;
+
+	if (file->isDirectory)
 	{
 		if (_locationConfig->getAutoindex())
 		{
 			std::string autoindex = generateAutoIndex(fullPath, _request.getTarget());
-			std::ostringstream oss;
-			oss << "HTTP/1.1 200 OK\r\n";
-			oss << "Server: webserver/1.0\r\n";
-			oss << "Date: " << getCurrentTime() << "\r\n";
-			setContentType(fullPath, oss);
+			// The listing changes with the directory's mtime, its length tells apart the URIs of one directory
+			char etag[kMaxEtagLength + 2];
+			size_t etagLength = formatEtag(file->mtime, autoindex.length(), etag, kMaxEtagLength);
+			if (isGzipCandidate("text/html", autoindex.length()))
+				_encodingHeaders = "Vary: Accept-Encoding\r\n";
+			if (isNotModified(file->mtime, etag, etagLength))
+			{
+				appendNotModified(file->mtime, etag, etagLength);
+				return;
+			}
+			if (_encodingHeaders != NULL && gzipBody(autoindex))
+			{
+				_encodingHeaders = "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+				// Other bytes than the plain listing, the ETag becomes weak
+				std::memmove(etag + 2, etag, etagLength);
+				std::memcpy(etag, "W/", 2);
+				etagLength += 2;
+			}
+			ArenaString oss(_arena);
+			oss << getStatusPrefix("200") << getDateHeader();
+			appendExpires(oss);
+			appendEncoding(oss);
+			appendValidators(oss, file->mtime, etag, etagLength);
 			oss << "Content-Length: " << autoindex.length() << "\r\n";
 			oss << "Content-Type: text/html\r\n";
 			oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
-			oss << "\r\n"
-				<< autoindex;
-			_response.setResponse(oss.str());
+			oss << "\r\n";
+			_response.appendResponseView(oss.data(), oss.size());
+			_response.appendResponseData(autoindex);
 			return;
 		}
 		else
@@ -840,7 +1173,7 @@ void Connection::generateResponse()
 			throw std::runtime_error("403");
 		}
 	}
-	else if (isFile(fullPath))
+	else
 	{
 		std::string cgiPath = getCgiPath(fullPath);
 		if (!cgiPath.empty())
@@ -849,31 +1182,386 @@ void Connection::generateResponse()
 			_request.setState(S_CGI_PROCESSING);
 			return;
 		}
-		else if (!readFileToMemory(fullPath, body))
+		OpenFileInfo precompressed;
+		if (_locationConfig->getGzipStatic())
+			file = findPrecompressed(requestPath, file, precompressed, cached);
+		char etag[kMaxEtagLength];
+		size_t etagLength = formatEtag(file->mtime, file->size, etag, sizeof(etag));
+		if (isNotModified(file->mtime, etag, etagLength))
 		{
-			throw std::runtime_error("403");
+			if (!cached)
+				closeFd(file->fd);
+			appendNotModified(file->mtime, etag, etagLength);
+			return;
+		}
+		std::vector<ByteRange> ranges;
+		RangeResult range = RANGE_NONE;
+		if (isRangeCurrent(file->mtime, etag, etagLength))
+			range = parseRange(file->size, ranges);
+		if (range == RANGE_UNSATISFIABLE)
+		{
+			if (!cached)
+				closeFd(file->fd);
+			appendRangeNotSatisfiable(file->size);
+			return;
+		}
+		if (range == RANGE_NONE && sendFromResponseCache(*file, fullPath, etag, etagLength))
+		{
+			if (!cached)
+				closeFd(file->fd);
+			return;
+		}
+		// Only the header block is kept in memory, the body is sent with sendfile().
+		// The response owns its descriptor, a cached one is duplicated
+		int fileFd = file->fd;
+		if (cached)
+			fileFd = fcntl(file->fd, F_DUPFD_CLOEXEC, 0);
+		if (fileFd == -1)
+			throw std::runtime_error("500");
+		if (range == RANGE_SATISFIABLE)
+		{
+			appendPartialContent(*file, fullPath, fileFd, ranges, etag, etagLength);
+			return;
+		}
+		ArenaString oss(_arena);
+		oss << getStatusPrefix("200") << getDateHeader();
+		appendExpires(oss);
+		appendEncoding(oss);
+		appendValidators(oss, file->mtime, etag, etagLength);
+		oss << "Accept-Ranges: bytes\r\n";
+		setContentType(fullPath, oss);
+		oss << "Content-Length: " << file->size << "\r\n";
+		oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
+		oss << "\r\n";
+		_response.appendResponseView(oss.data(), oss.size());
+		_response.appendFileBody(fileFd, 0, file->size);
+	}
+}
+
+// Small files are answered from memory, the stored response is built on the first miss
+bool Connection::sendFromResponseCache(const OpenFileInfo &file, const std::string &typePath,
+									   const char *etag, size_t etagLength)
+{
+	ResponseCache &cache = _webserver->getResponseCache();
+	if (!cache.isEnabled() || static_cast<size_t>(file.size) > cache.getMaxFileSize())
+		return false;
+	SharedBuffer *stored = cache.find(file.path, _keepAlive, file);
+	if (stored == NULL)
+	{
+		// Everything after the status line, Date and Expires, those change per response
+		ArenaString headers(_arena);
+		appendValidators(headers, file.mtime, etag, etagLength);
+		headers << "Accept-Ranges: bytes\r\n";
+		setContentType(typePath, headers);
+		headers << "Content-Length: " << file.size << "\r\n";
+		headers << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
+		headers << "\r\n";
+		std::string response;
+		response.reserve(headers.size() + file.size);
+		response.append(headers.data(), headers.size());
+		response.resize(headers.size() + file.size);
+		off_t offset = 0;
+		while (offset < file.size)
+		{
+			ssize_t nbytes = pread(file.fd, &response[headers.size() + offset], file.size - offset, offset);
+			if (nbytes <= 0)
+				return false; // changed under us, let sendfile() deal with it
+			offset += nbytes;
+		}
+		stored = cache.insert(file.path, _keepAlive, file, response);
+		if (stored == NULL)
+			return false;
+	}
+	ArenaString oss(_arena);
+	oss << getStatusPrefix("200") << getDateHeader();
+	appendExpires(oss);
+	appendEncoding(oss);
+	_response.appendResponseView(oss.data(), oss.size());
+	_response.appendResponseShared(stored);
+	return true;
+}
+
+// Evaluates the conditional headers of a GET, If-None-Match wins over If-Modified-Since
+bool Connection::isNotModified(time_t mtime, const char *etag, size_t etagLength) const
+{
+	if (_request.getMethod() != "GET")
+		return false;
+	if (_request.hasHeader(H_IF_NONE_MATCH))
+		return etagLength > 0 && etagMatches(_request.getHeader(H_IF_NONE_MATCH), etag, etagLength);
+	time_t since;
+	if (_request.hasHeader(H_IF_MODIFIED_SINCE) && parseHttpDate(_request.getHeader(H_IF_MODIFIED_SINCE), since))
+		return mtime <= since;
+	return false;
+}
+
+// If-Range: the ranges only apply to the representation the client already has part of
+bool Connection::isRangeCurrent(time_t mtime, const char *etag, size_t etagLength) const
+{
+	if (!_request.hasHeader(H_IF_RANGE))
+		return true;
+	std::string value = _request.getHeader(H_IF_RANGE);
+	// Strong comparison, a weak tag never matches
+	if (!value.empty() && (value[0] == '"' || value.compare(0, 2, "W/") == 0))
+		return etagLength > 0 && value.length() == etagLength && value.compare(0, etagLength, etag) == 0;
+	time_t date;
+	return parseHttpDate(value, date) && date == mtime;
+}
+
+// Decimal offset in value[begin, end), false if empty, not a number or too large for off_t
+static bool parseOffset(const std::string &value, size_t begin, size_t end, off_t &offset)
+{
+	if (begin >= end || end - begin > 18)
+		return false;
+	offset = 0;
+	for (size_t i = begin; i < end; ++i)
+	{
+		if (value[i] < '0' || value[i] > '9')
+			return false;
+		offset = offset * 10 + (value[i] - '0');
+	}
+	return true;
+}
+
+// "bytes=" then a list of first-last, first- and -suffix specs, clamped to the file.
+// A malformed header or too many ranges are ignored and the whole file is sent
+RangeResult Connection::parseRange(off_t size, std::vector<ByteRange> &ranges) const
+{
+	if (_request.getMethod() != "GET" || !_request.hasHeader(H_RANGE))
+		return RANGE_NONE;
+	std::string value = _request.getHeader(H_RANGE);
+	if (value.compare(0, 6, "bytes=") != 0)
+		return RANGE_NONE;
+	size_t specs = 0;
+	size_t pos = 6;
+	while (pos <= value.length())
+	{
+		size_t end = value.find(',', pos);
+		if (end == std::string::npos)
+			end = value.length();
+		size_t first = pos;
+		size_t last = end;
+		pos = end + 1;
+		while (first < last && (value[first] == ' ' || value[first] == '\t'))
+			++first;
+		while (last > first && (value[last - 1] == ' ' || value[last - 1] == '\t'))
+			--last;
+		if (first == last)
+			continue; // empty list element
+		if (++specs > kMaxRanges)
+			return RANGE_NONE;
+		size_t dash = value.find('-', first);
+		if (dash == std::string::npos || dash >= last)
+			return RANGE_NONE;
+		ByteRange range;
+		if (dash == first)
+		{
+			// Suffix: the last N bytes
+			off_t length;
+			if (!parseOffset(value, dash + 1, last, length))
+				return RANGE_NONE;
+			if (length == 0 || size == 0)
+				continue;
+			range.first = (length >= size) ? 0 : size - length;
+			range.last = size - 1;
 		}
 		else
 		{
-			std::ostringstream oss;
-			oss << "HTTP/1.1 200 OK\r\n";
-			oss << "Server: webserver/1.0\r\n";
-			oss << "Date: " << getCurrentTime() << "\r\n";
-			setContentType(fullPath, oss);
-			oss << "Content-Length: " << body.length() << "\r\n";
-			oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
-			oss << "\r\n"
-				<< body;
-			_response.setResponse(oss.str());
+			if (!parseOffset(value, first, dash, range.first))
+				return RANGE_NONE;
+			range.last = size - 1;
+			if (dash + 1 < last)
+			{
+				off_t rangeLast;
+				if (!parseOffset(value, dash + 1, last, rangeLast) || rangeLast < range.first)
+					return RANGE_NONE;
+				if (rangeLast < range.last)
+					range.last = rangeLast;
+			}
+			if (range.first >= size)
+				continue;
+		}
+		ranges.push_back(range);
+	}
+	if (specs == 0)
+		return RANGE_NONE;
+	return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_SATISFIABLE;
+}
+
+// 206, each range is sent from its offset in the file, nothing is read into memory.
+// Several ranges make a multipart/byteranges body, one descriptor per part
+void Connection::appendPartialContent(const OpenFileInfo &file, const std::string &typePath, int fileFd,
+									  const std::vector<ByteRange> &ranges, const char *etag, size_t etagLength)
+{
+	ArenaString oss(_arena);
+	oss << getStatusPrefix("206") << getDateHeader();
+	appendExpires(oss);
+	appendEncoding(oss);
+	appendValidators(oss, file.mtime, etag, etagLength);
+	oss << "Accept-Ranges: bytes\r\n";
+	if (ranges.size() == 1)
+	{
+		setContentType(typePath, oss);
+		oss << "Content-Range: bytes " << ranges[0].first << "-" << ranges[0].last << "/" << file.size << "\r\n";
+		oss << "Content-Length: " << ranges[0].last - ranges[0].first + 1 << "\r\n";
+		oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
+		oss << "\r\n";
+		_response.appendResponseView(oss.data(), oss.size());
+		_response.appendFileBody(fileFd, ranges[0].first, ranges[0].last - ranges[0].first + 1);
+		return;
+	}
+
+	std::vector<int> fds(ranges.size(), -1);
+	fds[0] = fileFd;
+	for (size_t i = 1; i < ranges.size(); ++i)
+	{
+		fds[i] = fcntl(fileFd, F_DUPFD_CLOEXEC, 0);
+		if (fds[i] == -1)
+		{
+			for (size_t j = 0; j < i; ++j)
+				closeFd(fds[j]);
+			throw std::runtime_error("500");
 		}
 	}
+	static unsigned long boundarySequence = 0;
+	char boundary[24];
+	std::snprintf(boundary, sizeof(boundary), "%020lu", ++boundarySequence);
+
+	// The part headers come first, Content-Length covers them too
+	ArenaString parts(_arena);
+	std::vector<size_t> partEnds;
+	off_t length = 0;
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		parts << "\r\n--" << boundary << "\r\n";
+		setContentType(typePath, parts);
+		parts << "Content-Range: bytes " << ranges[i].first << "-" << ranges[i].last << "/" << file.size << "\r\n\r\n";
+		partEnds.push_back(parts.size());
+		length += ranges[i].last - ranges[i].first + 1;
+	}
+	parts << "\r\n--" << boundary << "--\r\n";
+	length += parts.size();
+
+	oss << "Content-Type: multipart/byteranges; boundary=" << boundary << "\r\n";
+	oss << "Content-Length: " << length << "\r\n";
+	oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
+	oss << "\r\n";
+	_response.appendResponseView(oss.data(), oss.size());
+	size_t partStart = 0;
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		_response.appendResponseView(parts.data() + partStart, partEnds[i] - partStart);
+		_response.appendFileBody(fds[i], ranges[i].first, ranges[i].last - ranges[i].first + 1);
+		partStart = partEnds[i];
+	}
+	_response.appendResponseView(parts.data() + partStart, parts.size() - partStart);
+}
+
+void Connection::appendRangeNotSatisfiable(off_t size)
+{
+	ArenaString oss(_arena);
+	oss << getStatusPrefix("416") << getDateHeader();
+	oss << "Content-Range: bytes */" << size << "\r\n";
+	oss << "Content-Length: 0\r\n";
+	oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
+	oss << "\r\n";
+	_response.appendResponseView(oss.data(), oss.size());
+}
+
+// 304 carries the headers a 200 would have for the cache to refresh, but no body
+void Connection::appendNotModified(time_t mtime, const char *etag, size_t etagLength)
+{
+	ArenaString oss(_arena);
+	oss << getStatusPrefix("304") << getDateHeader();
+	appendExpires(oss);
+	appendEncoding(oss);
+	appendValidators(oss, mtime, etag, etagLength);
+	oss << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
+	oss << "\r\n";
+	_response.appendResponseView(oss.data(), oss.size());
+}
+
+void Connection::appendValidators(ArenaString &oss, time_t mtime, const char *etag, size_t etagLength)
+{
+	char date[kMaxHttpDateLength];
+	size_t dateLength = formatHttpDate(mtime, date, sizeof(date));
+	oss << "Last-Modified: ";
+	oss.append(date, dateLength);
+	if (etagLength > 0)
+	{
+		oss << "\r\nETag: ";
+		oss.append(etag, etagLength);
+	}
+	oss << "\r\n";
+}
+
+// Expires and Cache-Control from the location's expires directive
+void Connection::appendExpires(ArenaString &oss)
+{
+	ExpiresMode mode = _locationConfig->getExpiresMode();
+	if (mode == EXPIRES_OFF)
+		return;
+	if (mode == EXPIRES_EPOCH)
+	{
+		oss << "Expires: Thu, 01 Jan 1970 00:00:01 GMT\r\nCache-Control: no-cache\r\n";
+		return;
+	}
+	long seconds = (mode == EXPIRES_MAX) ? kMaxExpires : _locationConfig->getExpiresSeconds();
+	char date[kMaxHttpDateLength];
+	size_t dateLength = formatHttpDate(time(NULL) + seconds, date, sizeof(date));
+	oss << "Expires: ";
+	oss.append(date, dateLength);
+	if (seconds <= 0)
+		oss << "\r\nCache-Control: no-cache\r\n";
 	else
+		oss << "\r\nCache-Control: max-age=" << seconds << "\r\n";
+}
+
+// gzip directives: whether a body of this type and length is compressed for the clients that accept it
+bool Connection::isGzipCandidate(const std::string &contentType, size_t length) const
+{
+	if (_locationConfig == NULL || !_locationConfig->getGzip() || length == 0 ||
+		length < _locationConfig->getGzipMinLength())
+		return false;
+	size_t end = contentType.find(';');
+	if (end == std::string::npos)
+		end = contentType.length();
+	while (end > 0 && (contentType[end - 1] == ' ' || contentType[end - 1] == '\t'))
+		--end;
+	std::string type = contentType.substr(0, end);
+	for (size_t i = 0; i < type.length(); ++i)
+		type[i] = std::tolower(type[i]);
+	if (type == "text/html")
+		return true;
+	const std::set<std::string> &types = _locationConfig->getGzipTypes();
+	return types.find(type) != types.end() || types.find("*") != types.end();
+}
+
+// Compresses body in place when the client accepts gzip and the worker is not overloaded
+bool Connection::gzipBody(std::string &body)
+{
+	if (!_request.hasHeader(H_ACCEPT_ENCODING) || !acceptsEncoding(_request.getHeader(H_ACCEPT_ENCODING), "gzip"))
+		return false;
+	DeflatePool &pool = _webserver->getDeflatePool();
+	if (!pool.isAvailable())
 	{
-		throw std::runtime_error("404");
+		pool.countSkipped();
+		return false;
 	}
+	std::string compressed;
+	if (!pool.compress(body.data(), body.length(), compressed))
+		return false;
+	body.swap(compressed);
+	return true;
+}
+
+// Set by findPrecompressed() for a static file, or for a compressed listing
+void Connection::appendEncoding(ArenaString &oss)
+{
+	if (_encodingHeaders != NULL)
+		oss << _encodingHeaders;
 }
 
-void Connection::setContentType(const std::string &path, std::ostringstream &oss)
+void Connection::setContentType(const std::string &path, ArenaString &oss)
 {
 	if (path.find(".html") != std::string::npos)
 		oss << "Content-Type: text/html\r\n";
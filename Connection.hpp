@@ -1,16 +1,27 @@
 #pragma once
 
 #include <ctime>
+#include <stdint.h>
 #include <string>
+#include <vector>
 #include "Consts.hpp"
 #include "HttpRequest.hpp"
 #include "HttpResponse.hpp"
 #include "CGI.hpp"
+#include "Arena.hpp"
+#include "OpenFileCache.hpp"
 
 class Server;
 class Location;
 class WebServer;
 
+// Inclusive byte offsets, like in Content-Range
+struct ByteRange
+{
+	off_t first;
+	off_t last;
+};
+
 class Connection
 {
 public:
@@ -22,6 +33,12 @@ public:
 	Connection &operator=(const Connection &connection);
 	~Connection();
 
+	// Pool support: attach() gives a recycled object a new client, detach() drops the old one
+	void attach(int fd,
+				const std::string &port, const std::string &host,
+				const std::string &remotePort, const std::string &remoteHost);
+	void detach();
+
 	// Setters / Getters
 	int getFd() const;
 	void setFd(int fd);
@@ -40,14 +57,19 @@ public:
 	void setLastActivityTime(time_t lastActivityTime);
 	void updateActivityTime();
 
+	time_t getTimerDeadline() const;
+	void setTimerDeadline(time_t deadline);
+
 	Server *getServerConfig() const;
 	void setServerConfig(Server *serverConfig);
 
 	Location *getLocationConfig() const;
 	void setLocationConfig(Location *locationConfig);
 
-	const std::string &getResponse() const;
-	void eraseResponse(int nbytes);
+	ssize_t sendResponse(int sockFd);
+	bool isResponseComplete() const;
+	bool isReadingRequest() const;
+	RequestState getRequestState() const;
 
 	pid_t getCgiPid() const;
 	void setCgiPid(pid_t pid);
@@ -61,10 +83,19 @@ public:
 	bool isKeepAlive() const;
 	bool isAllowdMethod(const std::string &method, const std::map<std::string, bool> methods) const;
 	std::string generateAutoIndex(const std::string &path, const std::string &target) const;
-	RequestState handleClientRecv(const std::string &raw);
+	RequestState handleClientRecv(const char *data, size_t len);
+	RequestState resumePipeline();
+	bool isCgiRunning() const;
 	RequestState handleCgiRecv(int fd);
 	RequestState finalizeCgiRecv(int fd);
 	RequestState handleCgiSend(int fd);
+	// FastCGI requests run through the worker's FastCgiPool instead of a process
+	void buildFastCgiParams(std::vector<std::string> &params) const;
+	const std::string &getFastCgiStdin() const;
+	void setFastCgiRequest(int fd, uint16_t requestId);
+	bool appendFastCgiOutput(const char *data, size_t len);
+	void finalizeFastCgi();
+	void failFastCgi();
 	void reset();
 
 private:
@@ -75,23 +106,53 @@ private:
 	std::string _remotePort;
 	std::string _remoteHost;
 	time_t _lastActivityTime;
+	time_t _timerDeadline; // 0 if no timer is armed
 	Server *_serverConfig;
 	Location *_locationConfig;
+	std::string _routedHost; // Host header _routedServer was resolved for
+	Server *_routedServer;	 // kept across the requests of a keep-alive connection, NULL if none
 	CGI _cgi;
+	int _fastCgiFd;			 // backend socket of the FastCGI request in flight, -1 if none
+	uint16_t _fastCgiId;
 	HttpRequest _request;
 	HttpResponse _response;
+	std::string _cgiOutput; // raw CGI output, parsed once the CGI is done
+	std::string _pipelined; // bytes received behind a request still waiting for its CGI
+	Arena _arena;			// response headers waiting in _response, reset once it is sent
+	const char *_encodingHeaders; // Content-Encoding and Vary of the static or autoindex response being built, or NULL
 	bool _keepAlive;
 
+	RequestState handleRequest(const char *data, size_t len, size_t &offset);
 	void setServerAndLocation();
 	std::string resolvePath(const std::string &root, const std::string &path) const;
 	void generateReturnDirectiveResponse(const std::string &status, const std::string &redirectPath);
+	void openStaticFile(const std::string &path, OpenFileInfo &info) const;
+	const OpenFileInfo *findStaticFile(const std::string &path, OpenFileInfo &resolved, bool &cached);
+	const OpenFileInfo *findPrecompressed(const std::string &requestPath, const OpenFileInfo *file,
+										  OpenFileInfo &resolved, bool &cached);
 	void generateResponse();
+	void abortFastCgi();
+	bool sendFromResponseCache(const OpenFileInfo &file, const std::string &typePath,
+							   const char *etag, size_t etagLength);
+	bool isNotModified(time_t mtime, const char *etag, size_t etagLength) const;
+	bool isRangeCurrent(time_t mtime, const char *etag, size_t etagLength) const;
+	RangeResult parseRange(off_t size, std::vector<ByteRange> &ranges) const;
+	void appendPartialContent(const OpenFileInfo &file, const std::string &typePath, int fileFd,
+							  const std::vector<ByteRange> &ranges, const char *etag, size_t etagLength);
+	void appendRangeNotSatisfiable(off_t size);
+	void appendNotModified(time_t mtime, const char *etag, size_t etagLength);
+	void appendValidators(ArenaString &oss, time_t mtime, const char *etag, size_t etagLength);
+	void appendExpires(ArenaString &oss);
+	void appendEncoding(ArenaString &oss);
+	bool isGzipCandidate(const std::string &contentType, size_t length) const;
+	bool gzipBody(std::string &body);
+	void gzipCgiOutput(std::map<std::string, std::string> &headers);
 	std::string getCgiPath(const std::string &path) const;
-	void setContentType(const std::string &path, std::ostringstream &oss);
+	void setContentType(const std::string &path, ArenaString &oss);
 	bool processCgiHeaders(const std::string &cgiData, std::string &statusCode,
 						   std::map<std::string, std::string> &cgiHeaders,
-						   std::string &body);
-	std::string buildHttpResponse(const std::string &statusCode,
+						   size_t &bodyStart);
+	void appendHttpResponseHeader(const std::string &statusCode,
 								  const std::map<std::string, std::string> &headers,
-								  const std::string &body);
+								  size_t bodyLength);
 };
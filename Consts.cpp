@@ -15,6 +15,7 @@ std::string getCurrentDirPlusWww()
 
 const std::string kDefaultConfig = "conf/default.conf";
 const int kMaxBuff = 65536; // 64k
+const int kMaxIovecs = 64; // segments gathered in one sendmsg()
 const std::string kDefaultHost = "0.0.0.0";
 const std::string kDefaultPort = "80";
 const std::string kDefaultListen = kDefaultHost + ":" + kDefaultPort;
@@ -105,5 +106,50 @@ const std::map<std::string, std::string> kStatusCodes(
 	statusCodesArr,
 	statusCodesArr + sizeof(statusCodesArr) / sizeof(statusCodesArr[0]));
 
+// Lower-case names of the HeaderId entries, in the same order
+const char *const kHeaderNames[H_KNOWN_COUNT] = {
+	"host",
+	"content-length",
+	"transfer-encoding",
+	"connection",
+	"content-type",
+	"if-none-match",
+	"if-modified-since",
+	"range",
+	"if-range",
+	"accept-encoding"};
+
 const size_t kMaxHexLength = 8; // maximum valid chunk size in hex would be "FFFFFFFF" (4GB in hex)
+const size_t kMinHeaderSpan = 16; // shorter leftovers of a read go through the byte-wise parser
 const bool kDefaultKeepAlive = true;
+const int kDefaultWorkerProcesses = 1; // single process, no master
+const int kMaxWorkerProcesses = 1024;
+const int kWorkerMinUptime = 1; // in seconds; a worker dying faster than this is not respawned
+const int kDefaultMultiAccept = 32; // connections accepted per listener wakeup
+const int kMaxMultiAccept = 65536;
+const int kDefaultEventsPerWakeup = 512; // epoll events returned by one epoll_wait()
+const int kMaxEventsPerWakeup = 65536;
+const int kDefaultConnectionPool = 256; // idle Connection objects kept for reuse
+const int kMaxConnectionPool = 65536;
+const int kDefaultOpenFileCache = 0; // open_file_cache is off unless configured
+const int kMaxOpenFileCache = 65536; // every entry may hold a file descriptor
+const int kDefaultOpenFileCacheValid = 60; // in seconds
+const int kMaxOpenFileCacheValid = 86400;
+const size_t kMaxEtagLength = 40; // quoted "<mtime>-<length>" in hex, with the terminating NUL
+const size_t kMaxHttpDateLength = 32; // "Sun, 06 Nov 1994 08:49:37 GMT" with the terminating NUL
+const long kMaxExpires = 315360000; // in seconds, 10 years, also the max-age sent by "expires max"
+const size_t kMaxRanges = 16; // more ranges in one request and the whole file is sent instead
+const size_t kDefaultResponseCacheMaxFileSize = 65536; // larger files are always sent with sendfile()
+const size_t kDefaultGzipMinLength = 20; // shorter bodies would grow from the gzip header and trailer
+const int kGzipCompLevel = 1; // fastest, most of the gain of text for a fraction of the CPU
+const unsigned kGzipChunk = 16384; // output produced per deflate() call
+const size_t kGzipPoolSize = 4; // idle deflate streams kept by a worker
+const long kGzipMaxLoopLag = 50; // in milliseconds, a slower event loop round turns compression off
+const size_t kPooledBufferLimit = 65536; // larger buffers are freed when a connection goes back to the pool
+const size_t kVirtualHostTableMinSize = 16; // slots, a power of two
+const size_t kExactLocationTableMinSize = 8; // slots, a power of two
+const size_t kFastCgiMaxConnections = 8; // sockets a worker keeps open to one FastCGI backend
+const std::string kDefaultEventBackend = "epoll";
+const unsigned kIoUringEntries = 1024; // submission ring size, the completion ring is twice as large
+const size_t kArenaBlockSize = 4096; // a connection's arena keeps one such block between requests
+const size_t kArenaStringCapacity = 256; // first reservation of an ArenaString, fits a typical response header
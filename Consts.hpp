@@ -39,8 +39,51 @@ enum RequestState
 	S_CGI_PROCESSING,
 };
 
+// Headers the server looks at, found in O(1) instead of scanning the list
+enum HeaderId
+{
+	H_HOST,
+	H_CONTENT_LENGTH,
+	H_TRANSFER_ENCODING,
+	H_CONNECTION,
+	H_CONTENT_TYPE,
+	H_IF_NONE_MATCH,
+	H_IF_MODIFIED_SINCE,
+	H_RANGE,
+	H_IF_RANGE,
+	H_ACCEPT_ENCODING,
+	H_KNOWN_COUNT
+};
+
+// Outcome of parsing a Range header against the size of the file
+enum RangeResult
+{
+	RANGE_NONE,			 // no usable Range header, the whole file is sent
+	RANGE_SATISFIABLE,	 // at least one range overlaps the file, 206
+	RANGE_UNSATISFIABLE // none does, 416
+};
+
+// What the expires directive adds to static responses
+enum ExpiresMode
+{
+	EXPIRES_OFF,   // no Expires or Cache-Control header
+	EXPIRES_EPOCH, // already expired, Cache-Control: no-cache
+	EXPIRES_MAX,   // far in the future, for assets with versioned names
+	EXPIRES_TIME   // the given number of seconds after the response
+};
+
+// How the path of a location block is compared to the request target
+enum LocationModifier
+{
+	LOC_PREFIX,		 // location /path: longest prefix, the regexes still come first
+	LOC_PREFIX_STOP, // location ^~ /path: longest prefix, the regexes are skipped
+	LOC_EXACT,		 // location = /path: the whole target, checked before anything else
+	LOC_REGEX		 // location ~ pattern: POSIX extended regex, first match in config order
+};
+
 extern const std::string kDefaultConfig;
 extern const int kMaxBuff;
+extern const int kMaxIovecs;
 extern const std::string kDefaultListen;
 extern const std::string kDefaultHost;
 extern const std::string kDefaultPort;
@@ -54,5 +97,38 @@ extern const std::vector<std::string> kDefaultIndex;
 extern const std::map<int, std::string> kDefaultErrorPages;
 extern const bool kDefaultAutoindex;
 extern const std::map<std::string, std::string> kStatusCodes;
+extern const char *const kHeaderNames[H_KNOWN_COUNT];
 extern const size_t kMaxHexLength;
+extern const size_t kMinHeaderSpan;
 extern const bool kDefaultKeepAlive;
+extern const int kDefaultWorkerProcesses;
+extern const int kMaxWorkerProcesses;
+extern const int kWorkerMinUptime;
+extern const int kDefaultMultiAccept;
+extern const int kMaxMultiAccept;
+extern const int kDefaultEventsPerWakeup;
+extern const int kMaxEventsPerWakeup;
+extern const int kDefaultConnectionPool;
+extern const int kMaxConnectionPool;
+extern const int kDefaultOpenFileCache;
+extern const int kMaxOpenFileCache;
+extern const int kDefaultOpenFileCacheValid;
+extern const int kMaxOpenFileCacheValid;
+extern const size_t kMaxEtagLength;
+extern const size_t kMaxHttpDateLength;
+extern const long kMaxExpires;
+extern const size_t kMaxRanges;
+extern const size_t kDefaultResponseCacheMaxFileSize;
+extern const size_t kDefaultGzipMinLength;
+extern const int kGzipCompLevel;
+extern const unsigned kGzipChunk;
+extern const size_t kGzipPoolSize;
+extern const long kGzipMaxLoopLag;
+extern const size_t kPooledBufferLimit;
+extern const size_t kVirtualHostTableMinSize;
+extern const size_t kExactLocationTableMinSize;
+extern const size_t kFastCgiMaxConnections;
+extern const std::string kDefaultEventBackend;
+extern const unsigned kIoUringEntries;
+extern const size_t kArenaBlockSize;
+extern const size_t kArenaStringCapacity;
@@ -0,0 +1,138 @@
+#include <cstring>
+#include <algorithm>
+#include "DeflatePool.hpp"
+#include "Consts.hpp"
+
+static const uInt kMaxZlibInput = static_cast<uInt>(-1); // largest avail_in zlib takes at once
+
+DeflatePool::DeflatePool() : _free(),
+							 _overloaded(false),
+							 _compressed(0),
+							 _skipped(0)
+{
+}
+
+// Streams are not shared, a copy starts empty
+DeflatePool::DeflatePool(const DeflatePool &) : _free(),
+												_overloaded(false),
+												_compressed(0),
+												_skipped(0)
+{
+}
+
+DeflatePool &DeflatePool::operator=(const DeflatePool &other)
+{
+	if (this != &other)
+	{
+		clear();
+		_overloaded = false;
+	}
+	return *this;
+}
+
+DeflatePool::~DeflatePool()
+{
+	clear();
+}
+
+bool DeflatePool::isAvailable() const
+{
+	return !_overloaded;
+}
+
+void DeflatePool::setLoopLag(long milliseconds)
+{
+	_overloaded = (milliseconds > kGzipMaxLoopLag);
+}
+
+z_stream *DeflatePool::acquire()
+{
+	if (!_free.empty())
+	{
+		z_stream *stream = _free.back();
+		_free.pop_back();
+		return stream;
+	}
+	z_stream *stream = new z_stream;
+	std::memset(stream, 0, sizeof(*stream));
+	// windowBits 15 + 16: gzip header and trailer instead of zlib's
+	if (deflateInit2(stream, kGzipCompLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		delete stream;
+		return NULL;
+	}
+	return stream;
+}
+
+void DeflatePool::release(z_stream *stream)
+{
+	if (_free.size() < kGzipPoolSize && deflateReset(stream) == Z_OK)
+	{
+		_free.push_back(stream);
+		return;
+	}
+	deflateEnd(stream);
+	delete stream;
+}
+
+// Deflates in kGzipChunk steps into out, which is reserved for the worst case once.
+// avail_in is a 32-bit uInt, a larger body is fed to zlib in several parts
+bool DeflatePool::compress(const char *data, size_t length, std::string &out)
+{
+	z_stream *stream = acquire();
+	if (stream == NULL)
+		return false;
+	size_t start = out.size();
+	out.reserve(start + deflateBound(stream, length) + kGzipChunk);
+	size_t remaining = length;
+	int ret = Z_OK;
+	while (ret == Z_OK)
+	{
+		if (stream->avail_in == 0 && remaining > 0)
+		{
+			uInt part = static_cast<uInt>(std::min(remaining, static_cast<size_t>(kMaxZlibInput)));
+			stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data + length - remaining));
+			stream->avail_in = part;
+			remaining -= part;
+		}
+		size_t used = out.size();
+		out.resize(used + kGzipChunk);
+		stream->next_out = reinterpret_cast<Bytef *>(&out[used]);
+		stream->avail_out = kGzipChunk;
+		ret = deflate(stream, remaining == 0 ? Z_FINISH : Z_NO_FLUSH);
+		out.resize(used + kGzipChunk - stream->avail_out);
+	}
+	release(stream);
+	if (ret != Z_STREAM_END)
+	{
+		out.resize(start);
+		return false;
+	}
+	++_compressed;
+	return true;
+}
+
+void DeflatePool::clear()
+{
+	for (size_t i = 0; i < _free.size(); ++i)
+	{
+		deflateEnd(_free[i]);
+		delete _free[i];
+	}
+	_free.clear();
+}
+
+unsigned long DeflatePool::getCompressed() const
+{
+	return _compressed;
+}
+
+unsigned long DeflatePool::getSkipped() const
+{
+	return _skipped;
+}
+
+void DeflatePool::countSkipped()
+{
+	++_skipped;
+}
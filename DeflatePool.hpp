@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <zlib.h>
+
+/**
+ * gzip compression of dynamic response bodies, with the deflate streams
+ * kept between responses: deflateReset() is much cheaper than setting up
+ * the ~256k of zlib state again.
+ * The worker reports how long each event loop round took, compression is
+ * skipped while that lag is over kGzipMaxLoopLag so it never starves
+ * the connections waiting behind it.
+ */
+class DeflatePool
+{
+public:
+	DeflatePool();
+	DeflatePool(const DeflatePool &other);
+	DeflatePool &operator=(const DeflatePool &other);
+	~DeflatePool();
+
+	// False while the event loop is behind
+	bool isAvailable() const;
+	void setLoopLag(long milliseconds);
+
+	// Appends the gzip member of data to out, false if zlib failed
+	bool compress(const char *data, size_t length, std::string &out);
+	void clear();
+
+	unsigned long getCompressed() const;
+	unsigned long getSkipped() const;
+	void countSkipped();
+
+private:
+	std::vector<z_stream *> _free; // initialized streams, at most kGzipPoolSize
+	bool _overloaded;
+	unsigned long _compressed;
+	unsigned long _skipped;
+
+	z_stream *acquire();
+	void release(z_stream *stream);
+};
@@ -0,0 +1,59 @@
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include "EpollBackend.hpp"
+
+EpollBackend::EpollBackend() : _epfd(-1)
+{
+	_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epfd == -1)
+	{
+		perror("epoll_create1");
+		throw std::runtime_error("epoll_create1");
+	}
+}
+
+EpollBackend::~EpollBackend()
+{
+	if (_epfd != -1 && close(_epfd) == -1)
+	{
+		int err = errno;
+		std::cerr << "close (" << _epfd << "): " << strerror(err) << std::endl;
+	}
+}
+
+const char *EpollBackend::getName() const
+{
+	return "epoll";
+}
+
+bool EpollBackend::control(int op, int fd, uint32_t events)
+{
+	struct epoll_event ev;
+	ev.events = events;
+	ev.data.fd = fd;
+	return epoll_ctl(_epfd, op, fd, &ev) == 0;
+}
+
+bool EpollBackend::add(int fd, uint32_t events)
+{
+	return control(EPOLL_CTL_ADD, fd, events);
+}
+
+bool EpollBackend::modify(int fd, uint32_t events)
+{
+	return control(EPOLL_CTL_MOD, fd, events);
+}
+
+bool EpollBackend::remove(int fd)
+{
+	return epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == 0;
+}
+
+int EpollBackend::wait(struct epoll_event *events, int maxEvents, int timeoutMs)
+{
+	return epoll_wait(_epfd, events, maxEvents, timeoutMs);
+}
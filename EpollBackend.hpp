@@ -0,0 +1,22 @@
+#pragma once
+#include "EventBackend.hpp"
+
+class EpollBackend : public EventBackend
+{
+public:
+	EpollBackend();
+	~EpollBackend();
+
+	const char *getName() const;
+	bool add(int fd, uint32_t events);
+	bool modify(int fd, uint32_t events);
+	bool remove(int fd);
+	int wait(struct epoll_event *events, int maxEvents, int timeoutMs);
+
+private:
+	int _epfd;
+
+	EpollBackend(const EpollBackend &other);
+	EpollBackend &operator=(const EpollBackend &other);
+	bool control(int op, int fd, uint32_t events);
+};
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <stdexcept>
+#include "EventBackend.hpp"
+#include "EpollBackend.hpp"
+#include "IoUringBackend.hpp"
+
+EventBackend::EventBackend()
+{
+}
+
+EventBackend::~EventBackend()
+{
+}
+
+// Creates the requested backend, io_uring falls back to epoll when the kernel refuses it
+EventBackend *EventBackend::create(const std::string &name)
+{
+	if (name == "io_uring")
+	{
+		try
+		{
+			return new IoUringBackend();
+		}
+		catch (const std::runtime_error &e)
+		{
+			std::cerr << "io_uring unavailable (" << e.what() << "), falling back to epoll" << std::endl;
+		}
+	}
+	return new EpollBackend();
+}
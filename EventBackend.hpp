@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/**
+ * Readiness notification interface used by the event loop.
+ * Interest masks and ready events use the epoll vocabulary (EPOLLIN,
+ * EPOLLOUT, EPOLLRDHUP, EPOLLET, ...) whatever the implementation is.
+ */
+class EventBackend
+{
+public:
+	virtual ~EventBackend();
+
+	virtual const char *getName() const = 0;
+	virtual bool add(int fd, uint32_t events) = 0;
+	virtual bool modify(int fd, uint32_t events) = 0;
+	virtual bool remove(int fd) = 0;
+	// Same contract as epoll_wait(): number of ready events, -1 and errno on error
+	virtual int wait(struct epoll_event *events, int maxEvents, int timeoutMs) = 0;
+
+	static EventBackend *create(const std::string &name);
+
+protected:
+	EventBackend();
+
+private:
+	EventBackend(const EventBackend &other);
+	EventBackend &operator=(const EventBackend &other);
+};
@@ -0,0 +1,380 @@
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include "FastCgiPool.hpp"
+#include "Connection.hpp"
+#include "FileUtils.hpp"
+#include "Consts.hpp"
+
+// Record types and values of the FastCGI 1.0 specification
+static const unsigned char kFcgiVersion = 1;
+static const unsigned char kFcgiBeginRequest = 1;
+static const unsigned char kFcgiEndRequest = 3;
+static const unsigned char kFcgiParams = 4;
+static const unsigned char kFcgiStdin = 5;
+static const unsigned char kFcgiStdout = 6;
+static const unsigned char kFcgiStderr = 7;
+static const unsigned char kFcgiResponder = 1;
+static const unsigned char kFcgiKeepConn = 1;
+static const unsigned char kFcgiRequestComplete = 0;
+static const size_t kFcgiHeaderLength = 8;
+static const size_t kFcgiMaxContent = 65535;
+
+static void appendRecord(std::string &out, unsigned char type, uint16_t requestId, const char *data, size_t length)
+{
+	// Content is padded to a multiple of 8 bytes, as the reference implementation does
+	unsigned char padding = static_cast<unsigned char>((8 - length % 8) % 8);
+	char header[kFcgiHeaderLength] = {
+		static_cast<char>(kFcgiVersion), static_cast<char>(type),
+		static_cast<char>(requestId >> 8), static_cast<char>(requestId & 0xff),
+		static_cast<char>(length >> 8), static_cast<char>(length & 0xff),
+		static_cast<char>(padding), 0};
+	out.append(header, kFcgiHeaderLength);
+	out.append(data, length);
+	out.append(padding, '\0');
+}
+
+// A stream is split in records of at most kFcgiMaxContent bytes and ends with an empty one
+static void appendStream(std::string &out, unsigned char type, uint16_t requestId, const std::string &data)
+{
+	for (size_t offset = 0; offset < data.size(); offset += kFcgiMaxContent)
+		appendRecord(out, type, requestId, data.data() + offset, std::min(kFcgiMaxContent, data.size() - offset));
+	appendRecord(out, type, requestId, NULL, 0);
+}
+
+// Lengths below 128 take one byte, longer ones four with the high bit set
+static void appendParamLength(std::string &out, size_t length)
+{
+	if (length < 128)
+	{
+		out += static_cast<char>(length);
+		return;
+	}
+	out += static_cast<char>(((length >> 24) & 0x7f) | 0x80);
+	out += static_cast<char>((length >> 16) & 0xff);
+	out += static_cast<char>((length >> 8) & 0xff);
+	out += static_cast<char>(length & 0xff);
+}
+
+FastCgiPool::FastCgiPool() : _upstreams(), _finished()
+{
+}
+
+// Sockets are not shared, a copy starts empty
+FastCgiPool::FastCgiPool(const FastCgiPool &) : _upstreams(), _finished()
+{
+}
+
+FastCgiPool &FastCgiPool::operator=(const FastCgiPool &other)
+{
+	if (this != &other)
+		clear();
+	return *this;
+}
+
+FastCgiPool::~FastCgiPool()
+{
+	clear();
+}
+
+int FastCgiPool::connectTo(const std::string &address)
+{
+	int fd = -1;
+	int ret = -1;
+	if (address.compare(0, 5, "unix:") == 0)
+	{
+		struct sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::strncpy(addr.sun_path, address.c_str() + 5, sizeof(addr.sun_path) - 1);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd != -1)
+			ret = connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+	}
+	else
+	{
+		size_t colon = address.rfind(':');
+		std::string host = address.substr(0, colon);
+		std::string port = address.substr(colon + 1);
+		if (host.length() > 2 && host[0] == '[' && host[host.length() - 1] == ']')
+			host = host.substr(1, host.length() - 2);
+		struct addrinfo hints;
+		struct addrinfo *ai = NULL;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_NUMERICSERV;
+		int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &ai);
+		if (err != 0)
+		{
+			std::cerr << "fastcgi " << address << ": " << gai_strerror(err) << std::endl;
+			return -1;
+		}
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd != -1)
+		{
+			int nodelay = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int)); // best effort
+			ret = connect(fd, ai->ai_addr, ai->ai_addrlen);
+		}
+		freeaddrinfo(ai);
+	}
+	if (fd == -1 || (ret == -1 && errno != EINPROGRESS))
+	{
+		int err = errno;
+		std::cerr << "fastcgi " << address << ": " << strerror(err) << std::endl;
+		if (fd != -1)
+			closeFd(fd);
+		return -1;
+	}
+	Upstream &upstream = _upstreams[fd];
+	upstream.address = address;
+	upstream.connecting = (ret == -1);
+	upstream.outputSent = 0;
+	upstream.nextId = 1;
+	upstream.events = 0;
+	return fd;
+}
+
+// An idle socket, else a new one while under the limit, else the least busy one
+int FastCgiPool::pickUpstream(const std::string &address)
+{
+	int leastBusy = -1;
+	size_t count = 0;
+	size_t fewest = 0;
+	for (std::map<int, Upstream>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+	{
+		if (it->second.address != address)
+			continue;
+		if (it->second.requests.empty())
+			return it->first;
+		if (leastBusy == -1 || it->second.requests.size() < fewest)
+		{
+			leastBusy = it->first;
+			fewest = it->second.requests.size();
+		}
+		++count;
+	}
+	if (count < kFastCgiMaxConnections)
+	{
+		int fd = connectTo(address);
+		if (fd != -1)
+			return fd;
+	}
+	return leastBusy;
+}
+
+uint16_t FastCgiPool::newRequestId(Upstream &upstream)
+{
+	// 0 is reserved for the management records
+	while (upstream.nextId == 0 || upstream.requests.count(upstream.nextId) != 0)
+		++upstream.nextId;
+	return upstream.nextId++;
+}
+
+int FastCgiPool::submit(const std::string &address, Connection *conn, const std::vector<std::string> &params,
+						const std::string &body, uint16_t &requestId)
+{
+	int fd = pickUpstream(address);
+	if (fd == -1)
+		return -1;
+	Upstream &upstream = _upstreams[fd];
+	requestId = newRequestId(upstream);
+	upstream.requests[requestId] = conn;
+
+	const char begin[8] = {0, static_cast<char>(kFcgiResponder), static_cast<char>(kFcgiKeepConn), 0, 0, 0, 0, 0};
+	appendRecord(upstream.output, kFcgiBeginRequest, requestId, begin, sizeof(begin));
+	std::string encoded;
+	for (size_t i = 0; i < params.size(); ++i)
+	{
+		size_t equal = params[i].find('=');
+		if (equal == std::string::npos)
+			continue;
+		appendParamLength(encoded, equal);
+		appendParamLength(encoded, params[i].size() - equal - 1);
+		encoded.append(params[i], 0, equal);
+		encoded.append(params[i], equal + 1, std::string::npos);
+	}
+	appendStream(upstream.output, kFcgiParams, requestId, encoded);
+	appendStream(upstream.output, kFcgiStdin, requestId, body);
+	// Try right away, an idle socket usually takes the whole request.
+	// A failure shows up as an error event once the socket is watched
+	if (!upstream.connecting)
+		send(fd, upstream);
+	return fd;
+}
+
+void FastCgiPool::abort(int fd, uint16_t requestId)
+{
+	std::map<int, Upstream>::iterator it = _upstreams.find(fd);
+	if (it == _upstreams.end())
+		return;
+	std::map<uint16_t, Connection *>::iterator request = it->second.requests.find(requestId);
+	if (request != it->second.requests.end())
+		request->second = NULL; // the id stays taken until FCGI_END_REQUEST comes
+}
+
+bool FastCgiPool::handleEvent(int fd, uint32_t events)
+{
+	std::map<int, Upstream>::iterator it = _upstreams.find(fd);
+	if (it == _upstreams.end())
+		return false;
+	Upstream &upstream = it->second;
+	if (upstream.connecting)
+	{
+		int err = 0;
+		socklen_t errLength = sizeof(err);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLength) == -1 || err != 0)
+		{
+			std::cerr << "fastcgi " << upstream.address << ": " << strerror(err != 0 ? err : errno) << std::endl;
+			return false;
+		}
+		upstream.connecting = false;
+	}
+	if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !receive(fd, upstream))
+		return false;
+	return send(fd, upstream);
+}
+
+// Reads until the socket is empty, false on error or when the backend closed it
+bool FastCgiPool::receive(int fd, Upstream &upstream)
+{
+	char buf[kMaxBuff];
+	while (true)
+	{
+		ssize_t nbytes = recv(fd, buf, sizeof(buf), 0);
+		if (nbytes > 0)
+		{
+			upstream.input.append(buf, nbytes);
+			parseRecords(upstream);
+			continue;
+		}
+		if (nbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (nbytes == -1)
+			perror("recv from fastcgi");
+		return false;
+	}
+}
+
+bool FastCgiPool::send(int fd, Upstream &upstream)
+{
+	while (upstream.outputSent < upstream.output.size())
+	{
+		ssize_t nbytes = ::send(fd, upstream.output.data() + upstream.outputSent,
+								upstream.output.size() - upstream.outputSent, MSG_NOSIGNAL);
+		if (nbytes == -1)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			perror("send to fastcgi");
+			return false;
+		}
+		upstream.outputSent += nbytes;
+	}
+	upstream.output.clear();
+	upstream.outputSent = 0;
+	return true;
+}
+
+void FastCgiPool::parseRecords(Upstream &upstream)
+{
+	const std::string &in = upstream.input;
+	size_t offset = 0;
+	while (in.size() - offset >= kFcgiHeaderLength)
+	{
+		const unsigned char *header = reinterpret_cast<const unsigned char *>(in.data() + offset);
+		uint16_t requestId = static_cast<uint16_t>((header[2] << 8) | header[3]);
+		size_t length = (header[4] << 8) | header[5];
+		size_t recordLength = kFcgiHeaderLength + length + header[6];
+		if (in.size() - offset < recordLength)
+			break;
+		const char *content = in.data() + offset + kFcgiHeaderLength;
+		offset += recordLength;
+
+		std::map<uint16_t, Connection *>::iterator request = upstream.requests.find(requestId);
+		if (header[1] == kFcgiStderr)
+		{
+			std::cerr.write(content, length);
+			continue;
+		}
+		if (request == upstream.requests.end())
+			continue; // management record or an id we don't know
+		Connection *conn = request->second;
+		if (header[1] == kFcgiStdout && conn != NULL && length > 0)
+		{
+			if (!conn->appendFastCgiOutput(content, length))
+			{
+				request->second = NULL; // the output is too large, an error response is queued
+				_finished.push_back(conn);
+			}
+		}
+		else if (header[1] == kFcgiEndRequest)
+		{
+			upstream.requests.erase(request);
+			if (conn == NULL)
+				continue;
+			// protocolStatus is the fifth byte of the body, CANT_MPX_CONN or OVERLOADED are failures
+			if (length >= 5 && static_cast<unsigned char>(content[4]) == kFcgiRequestComplete)
+				conn->finalizeFastCgi();
+			else
+				conn->failFastCgi();
+			_finished.push_back(conn);
+		}
+	}
+	upstream.input.erase(0, offset);
+}
+
+bool FastCgiPool::updateEvents(int fd, uint32_t &events)
+{
+	std::map<int, Upstream>::iterator it = _upstreams.find(fd);
+	if (it == _upstreams.end())
+		return false;
+	events = EPOLLIN;
+	if (it->second.connecting || !it->second.output.empty())
+		events |= EPOLLOUT;
+	if (events == it->second.events)
+		return false;
+	it->second.events = events;
+	return true;
+}
+
+void FastCgiPool::close(int fd)
+{
+	std::map<int, Upstream>::iterator it = _upstreams.find(fd);
+	if (it == _upstreams.end())
+		return;
+	for (std::map<uint16_t, Connection *>::iterator request = it->second.requests.begin();
+		 request != it->second.requests.end(); ++request)
+	{
+		if (request->second == NULL)
+			continue;
+		request->second->failFastCgi();
+		_finished.push_back(request->second);
+	}
+	_upstreams.erase(it);
+	closeFd(fd);
+}
+
+std::vector<Connection *> &FastCgiPool::getFinished()
+{
+	return _finished;
+}
+
+// The connections are released before, no request is left to answer
+void FastCgiPool::clear()
+{
+	for (std::map<int, Upstream>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+		closeFd(it->first);
+	_upstreams.clear();
+	_finished.clear();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Connection;
+
+/**
+ * Connections of a worker to its FastCGI backends, kept open between
+ * requests (FCGI_KEEP_CONN) so a request costs a few records instead of a
+ * fork() and an interpreter start. Each backend address gets up to
+ * kFastCgiMaxConnections sockets: a request goes to an idle one, a new one
+ * is opened while under the limit, then requests are multiplexed on the
+ * least busy socket by their request id.
+ * The sockets are non-blocking and watched by the worker's event loop,
+ * which calls handleEvent() and then resumes the clients in getFinished().
+ */
+class FastCgiPool
+{
+public:
+	FastCgiPool();
+	FastCgiPool(const FastCgiPool &other);
+	FastCgiPool &operator=(const FastCgiPool &other);
+	~FastCgiPool();
+
+	// Queues the records of a request, returns the socket it goes out on or -1 if the backend can't be reached
+	int submit(const std::string &address, Connection *conn, const std::vector<std::string> &params,
+			   const std::string &body, uint16_t &requestId);
+	// The client is gone, what the backend still sends for the request is dropped
+	void abort(int fd, uint16_t requestId);
+	// Sends and receives what it can, false if the socket has to be closed
+	bool handleEvent(int fd, uint32_t events);
+	// Events to watch on fd, true if they changed since the last call
+	bool updateEvents(int fd, uint32_t &events);
+	// Closes the socket, its requests still running end with a 502
+	void close(int fd);
+	// Connections whose response is queued, emptied by the caller
+	std::vector<Connection *> &getFinished();
+	void clear();
+
+private:
+	struct Upstream
+	{
+		std::string address;
+		bool connecting; // non-blocking connect() still in progress
+		std::string output;
+		size_t outputSent;
+		std::string input;
+		std::map<uint16_t, Connection *> requests; // NULL once aborted
+		uint16_t nextId;
+		uint32_t events; // registered in the event loop
+	};
+
+	std::map<int, Upstream> _upstreams; // key: socket
+	std::vector<Connection *> _finished;
+
+	int connectTo(const std::string &address);
+	int pickUpstream(const std::string &address);
+	uint16_t newRequestId(Upstream &upstream);
+	bool receive(int fd, Upstream &upstream);
+	bool send(int fd, Upstream &upstream);
+	void parseRecords(Upstream &upstream);
+};
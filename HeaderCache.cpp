@@ -0,0 +1,48 @@
+#include <map>
+#include "HeaderCache.hpp"
+#include "Consts.hpp"
+
+static std::string g_dateHeader; // "Date: <IMF-fixdate>\r\n"
+static time_t g_dateSecond = -1; // second g_dateHeader was formatted for
+
+// Called by the event loop after each wakeup, formats at most once per second
+void refreshDateHeader(time_t now)
+{
+	if (now == g_dateSecond)
+		return;
+	char date[64];
+	size_t length = formatHttpDate(now, date, sizeof(date));
+	g_dateHeader.assign("Date: ", 6);
+	g_dateHeader.append(date, length); // same length every time, the capacity is reused
+	g_dateHeader.append("\r\n", 2);
+	g_dateSecond = now;
+}
+
+const std::string &getDateHeader()
+{
+	if (g_dateSecond == -1)
+		refreshDateHeader(time(NULL)); // used outside of the event loop
+	return g_dateHeader;
+}
+
+// IMF-fixdate, the only format HTTP/1.1 senders may use
+size_t formatHttpDate(time_t t, char *buf, size_t size)
+{
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	return strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// "HTTP/1.1 <code> <text>\r\nServer: webserver/1.0\r\n", built on first use of each code
+const std::string &getStatusPrefix(const std::string &statusCode)
+{
+	static std::map<std::string, std::string> prefixes;
+	std::map<std::string, std::string>::iterator it = prefixes.find(statusCode);
+	if (it != prefixes.end())
+		return it->second;
+	std::map<std::string, std::string>::const_iterator status = kStatusCodes.find(statusCode);
+	std::string prefix = "HTTP/1.1 " + statusCode + " ";
+	prefix += (status != kStatusCodes.end()) ? status->second : "Unknown Status Code";
+	prefix += "\r\nServer: webserver/1.0\r\n";
+	return prefixes.insert(std::make_pair(statusCode, prefix)).first->second;
+}
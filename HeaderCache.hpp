@@ -0,0 +1,11 @@
+#pragma once
+#include <ctime>
+#include <string>
+
+// Header lines shared by every response, formatted once instead of per response
+void refreshDateHeader(time_t now);
+const std::string &getDateHeader();
+const std::string &getStatusPrefix(const std::string &statusCode);
+
+// IMF-fixdate of t, written to buf like strftime()
+size_t formatHttpDate(time_t t, char *buf, size_t size);
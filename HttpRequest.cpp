@@ -1,9 +1,9 @@
 #include <cstdlib> // for atoi
 #include <iostream>
 #include <stdexcept>
-#include <sstream> // for stringstream
 #include <climits> // for LONG_MAX
 #include <cerrno>
+#include <algorithm> // for std::min
 #include "Globals.hpp"
 #include "HttpRequest.hpp"
 #include "Consts.hpp"
@@ -14,19 +14,22 @@ HttpRequest::HttpRequest(int clientHeaderBufferSize, int clientMaxBodySize) : _s
 																			  _target(""),
 																			  _query(""),
 																			  _version(""),
-																			  _headers(),
+																			  _headerData(),
+																			  _fields(),
+																			  _fieldStart(0),
+																			  _valueStart(0),
 																			  _body(""),
 																			  _headerLength(0),
 																			  _clientHeaderBufferSize(clientHeaderBufferSize),
 																			  _clientMaxBodySize(clientMaxBodySize),
-																			  _currentHeaderName(""),
-																			  _currentHeaderValue(""),
 																			  _expectedBodyLength(0),
 																			  _isChunked(false),
 																			  _currentChunkSize(0),
 																			  _currentChunkRead(0),
 																			  _chunkSizeLine("")
 {
+	for (int i = 0; i < H_KNOWN_COUNT; ++i)
+		_knownFields[i] = -1;
 }
 
 HttpRequest::HttpRequest(const HttpRequest &src) : _state(src._state),
@@ -34,19 +37,22 @@ HttpRequest::HttpRequest(const HttpRequest &src) : _state(src._state),
 												   _target(src._target),
 												   _query(src._query),
 												   _version(src._version),
-												   _headers(src._headers),
+												   _headerData(src._headerData),
+												   _fields(src._fields),
+												   _fieldStart(src._fieldStart),
+												   _valueStart(src._valueStart),
 												   _body(src._body),
 												   _headerLength(src._headerLength),
 												   _clientHeaderBufferSize(src._clientHeaderBufferSize),
 												   _clientMaxBodySize(src._clientMaxBodySize),
-												   _currentHeaderName(src._currentHeaderName),
-												   _currentHeaderValue(src._currentHeaderValue),
 												   _expectedBodyLength(src._expectedBodyLength),
 												   _isChunked(src._isChunked),
 												   _currentChunkSize(src._currentChunkSize),
 												   _currentChunkRead(src._currentChunkRead),
 												   _chunkSizeLine(src._chunkSizeLine)
 {
+	for (int i = 0; i < H_KNOWN_COUNT; ++i)
+		_knownFields[i] = src._knownFields[i];
 }
 
 HttpRequest &HttpRequest::operator=(const HttpRequest &src)
@@ -58,13 +64,16 @@ HttpRequest &HttpRequest::operator=(const HttpRequest &src)
 		_target = src._target;
 		_query = src._query;
 		_version = src._version;
-		_headers = src._headers;
+		_headerData = src._headerData;
+		_fields = src._fields;
+		for (int i = 0; i < H_KNOWN_COUNT; ++i)
+			_knownFields[i] = src._knownFields[i];
+		_fieldStart = src._fieldStart;
+		_valueStart = src._valueStart;
 		_body = src._body;
 		_headerLength = src._headerLength;
 		_clientHeaderBufferSize = src._clientHeaderBufferSize;
 		_clientMaxBodySize = src._clientMaxBodySize;
-		_currentHeaderName = src._currentHeaderName;
-		_currentHeaderValue = src._currentHeaderValue;
 		_expectedBodyLength = src._expectedBodyLength;
 		_isChunked = src._isChunked;
 		_currentChunkSize = src._currentChunkSize;
@@ -78,6 +87,30 @@ HttpRequest::~HttpRequest()
 {
 }
 
+// Gets ready for the next request on the connection. The header buffers keep
+// their capacity so a keep-alive connection stops allocating for them
+void HttpRequest::reset()
+{
+	_state = S_START;
+	_method.clear();
+	_target.clear();
+	_query.clear();
+	_version.clear();
+	_headerData.clear();
+	_fields.clear();
+	for (int i = 0; i < H_KNOWN_COUNT; ++i)
+		_knownFields[i] = -1;
+	_fieldStart = 0;
+	_valueStart = 0;
+	std::string().swap(_body); // don't keep a large upload allocated
+	_headerLength = 0;
+	_expectedBodyLength = 0;
+	_isChunked = false;
+	_currentChunkSize = 0;
+	_currentChunkRead = 0;
+	_chunkSizeLine.clear();
+}
+
 RequestState HttpRequest::getState() const
 {
 	return _state;
@@ -88,11 +121,31 @@ void HttpRequest::setState(RequestState state)
 	_state = state;
 }
 
-void HttpRequest::parseRequest(const std::string &raw)
+// Parses up to one request and returns the number of bytes consumed,
+// what follows a complete request belongs to the next pipelined one
+std::size_t HttpRequest::parseRequest(const char *data, std::size_t len)
 {
-	for (std::size_t i = 0; _state != S_DONE && _state != S_ERROR && i < raw.size(); i++)
+	std::size_t i = 0;
+	while (_state != S_DONE && _state != S_ERROR && i < len)
 	{
-		unsigned char c = raw[i];
+		if (_state == S_BODY || (_state == S_CHUNK && _currentChunkRead < _currentChunkSize))
+		{
+			// Body bytes are copied in bulk, not one switch dispatch per byte
+			i += parseBodySpan(data + i, len - i);
+			continue;
+		}
+		std::size_t span = len - i >= kMinHeaderSpan ? parseHeaderSpan(data + i, len - i) : 0;
+		if (span > 0)
+		{
+			i += span;
+			if (_headerLength > _clientHeaderBufferSize)
+			{
+				_state = S_ERROR;
+				throw std::runtime_error("413");
+			}
+			continue;
+		}
+		unsigned char c = data[i];
 		switch (_state)
 		{
 		case S_START:
@@ -169,12 +222,9 @@ void HttpRequest::parseRequest(const std::string &raw)
 		case S_CHUNK_END:
 			parseChunkEnd(c);
 			break;
-		case S_BODY:
-			parseBody(c);
-			break;
 		case S_DONE:
 			std::cerr << "Request already parsed" << std::endl;
-			return;
+			return i;
 		case S_ERROR:
 		default:
 			throw std::runtime_error("400");
@@ -186,7 +236,9 @@ void HttpRequest::parseRequest(const std::string &raw)
 			_state = S_ERROR;
 			throw std::runtime_error("413");
 		}
+		i++;
 	}
+	return i;
 }
 
 void HttpRequest::parseStart(unsigned char c)
@@ -386,12 +438,13 @@ void HttpRequest::parseHeaderName(unsigned char c)
 {
 	if (c == ':')
 	{
-		if (_currentHeaderName.empty())
+		if (_headerData.size() == _fieldStart)
 		{
 			_state = S_ERROR;
 			throw std::runtime_error("400");
 		}
 
+		_valueStart = _headerData.size();
 		_state = S_HEADER_COLON;
 		return;
 	}
@@ -403,9 +456,9 @@ void HttpRequest::parseHeaderName(unsigned char c)
 	}
 
 	if (c >= 'A' && c <= 'Z')
-		_currentHeaderName += c + 32; // convert to lower case
+		_headerData += c + 32; // convert to lower case
 	else
-		_currentHeaderName += c;
+		_headerData += c;
 }
 
 void HttpRequest::parseHeaderColon(unsigned char c)
@@ -420,7 +473,7 @@ void HttpRequest::parseHeaderColon(unsigned char c)
 	}
 
 	_state = S_HEADER_VALUE;
-	_currentHeaderValue += c;
+	_headerData += c;
 }
 
 void HttpRequest::parseHeaderValue(unsigned char c)
@@ -428,32 +481,7 @@ void HttpRequest::parseHeaderValue(unsigned char c)
 	if (c == '\r')
 	{
 		_state = S_HEADER_CR;
-		if (_headers.find("host") != _headers.end() && _currentHeaderName == "host")
-		{
-			_state = S_ERROR;
-			throw std::runtime_error("400");
-		} // TODO: handle additional duplicates
-
-		_currentHeaderValue = trimFromEnd(_currentHeaderValue);
-		if (_currentHeaderName == "transfer-encoding" && _headers.find("transfer-encoding") != _headers.end())
-		{
-			if (_currentHeaderValue == "chunked")
-				_isChunked = true;
-			_headers["transfer-encoding"] += ", " + _currentHeaderValue;
-		}
-		else if (_currentHeaderName == "connection")
-		{
-			if (_currentHeaderValue == "keep-alive")
-				_headers["connection"] = "keep-alive";
-			else if (_currentHeaderValue == "close")
-				_headers["connection"] = "close";
-		}
-		else
-		{
-			_headers[_currentHeaderName] = _currentHeaderValue;
-		}
-		_currentHeaderName = "";
-		_currentHeaderValue = "";
+		addHeaderField();
 		return;
 	}
 
@@ -463,7 +491,45 @@ void HttpRequest::parseHeaderValue(unsigned char c)
 		throw std::runtime_error("400");
 	}
 
-	_currentHeaderValue += c;
+	_headerData += c;
+}
+
+// Records the header line whose name and value were just appended to _headerData
+void HttpRequest::addHeaderField()
+{
+	// Trailing whitespace is not part of the value
+	size_t end = _headerData.size();
+	while (end > _valueStart && (_headerData[end - 1] == ' ' || _headerData[end - 1] == '\t'))
+		--end;
+	_headerData.resize(end);
+
+	HeaderField field;
+	field.nameOffset = _fieldStart;
+	field.nameLength = _valueStart - _fieldStart;
+	field.valueOffset = _valueStart;
+	field.valueLength = end - _valueStart;
+	_fieldStart = end;
+
+	int id = 0;
+	while (id < H_KNOWN_COUNT &&
+		   _headerData.compare(field.nameOffset, field.nameLength, kHeaderNames[id]) != 0)
+		++id;
+	if (id == H_HOST && _knownFields[H_HOST] != -1)
+	{
+		_state = S_ERROR;
+		throw std::runtime_error("400");
+	} // TODO: handle additional duplicates
+	if (id == H_TRANSFER_ENCODING &&
+		_headerData.find("chunked", field.valueOffset) < field.valueOffset + field.valueLength)
+		_isChunked = true; // in any of the transfer-encoding lines
+	_fields.push_back(field);
+	// Connection only changes with a "keep-alive" or "close" line, other values are ignored
+	if (id == H_CONNECTION &&
+		_headerData.compare(field.valueOffset, field.valueLength, "keep-alive") != 0 &&
+		_headerData.compare(field.valueOffset, field.valueLength, "close") != 0)
+		return;
+	if (id < H_KNOWN_COUNT)
+		_knownFields[id] = _fields.size() - 1; // the last line wins
 }
 
 void HttpRequest::parseHeaderCR(unsigned char c)
@@ -483,7 +549,7 @@ void HttpRequest::parseHeaderLF(unsigned char c)
 
 	if (c == '\r')
 	{
-		if (_headers.find("host") == _headers.end())
+		if (_knownFields[H_HOST] == -1)
 		{
 			_state = S_ERROR;
 			throw std::runtime_error("400");
@@ -500,9 +566,9 @@ void HttpRequest::parseHeaderLF(unsigned char c)
 	if (validHttpRequestChar(c))
 	{
 		if (c >= 'A' && c <= 'Z')
-			_currentHeaderName += c + 32; // convert to lower case
+			_headerData += c + 32; // convert to lower case
 		else
-			_currentHeaderName += c;
+			_headerData += c;
 	}
 	else
 	{
@@ -517,37 +583,40 @@ void HttpRequest::parseHeaderEnd(unsigned char c)
 	if (c == '\n')
 	{
 		// Check if there is a body
-		if (_headers.find("transfer-encoding") != _headers.end() &&
-			_headers["transfer-encoding"].find("chunked") != std::string::npos)
+		if (_isChunked)
 		{
 			_state = S_HEX;
 			return;
 		}
-		else if (_headers.find("content-length") != _headers.end())
+		else if (_knownFields[H_CONTENT_LENGTH] != -1)
 		{
-			try
+			const HeaderField &field = _fields[_knownFields[H_CONTENT_LENGTH]];
+			if (field.valueLength == 0)
+			{
+				_state = S_ERROR;
+				throw std::runtime_error("400");
+			}
+			_expectedBodyLength = 0;
+			for (size_t i = field.valueOffset; i < field.valueOffset + field.valueLength; ++i)
 			{
-				std::istringstream iss(_headers["content-length"]);
-				iss >> _expectedBodyLength;
-				if (iss.fail() || !iss.eof())
+				char digit = _headerData[i];
+				if (digit < '0' || digit > '9')
 				{
 					_state = S_ERROR;
 					throw std::runtime_error("400");
 				}
-				else if (_expectedBodyLength > _clientMaxBodySize)
+				_expectedBodyLength = _expectedBodyLength * 10 + (digit - '0');
+				if (_expectedBodyLength > _clientMaxBodySize)
 				{
 					_state = S_ERROR;
 					throw std::runtime_error("413");
 				}
 			}
-			catch (std::invalid_argument &ia)
-			{
-				_state = S_ERROR;
-				throw std::runtime_error("400");
-			}
 			_state = S_BODY;
 			if (_expectedBodyLength == 0)
 				_state = S_DONE;
+			else
+				_body.reserve(_expectedBodyLength); // one allocation for the whole body
 			return;
 		}
 		else
@@ -612,25 +681,14 @@ void HttpRequest::parseHexEnd(unsigned char c)
 	throw std::runtime_error("400");
 }
 
+// The chunk data itself goes through parseBodySpan(), only its CRLF is left
 void HttpRequest::parseChunk(unsigned char c)
 {
-	if (_currentChunkRead == _currentChunkSize && c == '\r')
+	if (c == '\r')
 	{
 		_state = S_CHUNK_END;
 		return;
 	}
-
-	if (_currentChunkRead < _currentChunkSize)
-	{
-		_currentChunkRead++;
-		_body += c;
-		if (_body.size() > _clientMaxBodySize)
-		{
-			_state = S_ERROR;
-			throw std::runtime_error("413");
-		}
-		return;
-	}
 	_state = S_ERROR;
 	throw std::runtime_error("400");
 }
@@ -646,16 +704,75 @@ void HttpRequest::parseChunkEnd(unsigned char c)
 	throw std::runtime_error("400");
 }
 
-void HttpRequest::parseBody(unsigned char c)
+/**
+ * Fast path for the long runs of the request line and headers: the bytes up
+ * to the next delimiter of the current state are validated and stored at
+ * once. The delimiter itself, and any byte the run rejects, is left to the
+ * state machine, which stays the only place that changes state or reports
+ * errors. Returns the number of bytes used, 0 when the next byte is not
+ * part of a run.
+ */
+std::size_t HttpRequest::parseHeaderSpan(const char *data, std::size_t len)
+{
+	std::size_t n = 0;
+	switch (_state)
+	{
+	case S_URI:
+		n = scanHttpRun(data, len, '!', '~', '?', '#');
+		_target.append(data, n);
+		break;
+	case S_QUERY:
+		n = scanHttpRun(data, len, '!', '~', '#', '#');
+		_query.append(data, n);
+		break;
+	case S_FRAGMENT:
+		n = scanHttpRun(data, len, '!', '~', '~', '~'); // not stored, see parseFragment()
+		break;
+	case S_HEADER_NAME:
+	{
+		n = scanHttpRun(data, len, '!', '~', ':', ':');
+		// Only token characters are allowed in a name, stop at anything else
+		std::size_t valid = 0;
+		while (valid < n && validHttpRequestChar(data[valid]))
+			valid++;
+		n = valid;
+		std::size_t start = _headerData.size();
+		_headerData.append(data, n);
+		for (std::size_t j = start; j < _headerData.size(); ++j)
+		{
+			if (_headerData[j] >= 'A' && _headerData[j] <= 'Z')
+				_headerData[j] += 32; // convert to lower case
+		}
+		break;
+	}
+	case S_HEADER_VALUE:
+		n = scanHttpRun(data, len, ' ', '~', '\r', '\r');
+		_headerData.append(data, n);
+		break;
+	default:
+		return 0;
+	}
+	_headerLength += n;
+	return n;
+}
+
+// Appends as much of data as the Content-Length body or the current chunk
+// still expects. Both were checked against client_max_body_size when their
+// size was parsed. Returns the number of bytes used
+std::size_t HttpRequest::parseBodySpan(const char *data, std::size_t len)
 {
-	if (_body.size() >= _clientMaxBodySize)
+	if (_state == S_BODY)
 	{
-		_state = S_ERROR;
-		throw std::runtime_error("413");
+		std::size_t n = std::min(len, _expectedBodyLength - _body.size());
+		_body.append(data, n);
+		if (_body.size() == _expectedBodyLength)
+			_state = S_DONE;
+		return n;
 	}
-	_body += c;
-	if (_body.size() == _expectedBodyLength)
-		_state = S_DONE;
+	std::size_t n = std::min(len, _currentChunkSize - _currentChunkRead);
+	_body.append(data, n);
+	_currentChunkRead += n;
+	return n;
 }
 
 void HttpRequest::printRequestDBG() const
@@ -668,18 +785,17 @@ void HttpRequest::printRequestDBG() const
 	std::cout << "Query: " << _query << std::endl;
 	std::cout << "Version: " << _version << std::endl;
 	std::cout << "Headers:" << std::endl;
-	for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it)
+	for (size_t i = 0; i < _fields.size(); ++i)
 	{
-		std::cout << "  " << it->first << ": " << it->second << std::endl;
+		std::cout << "  " << getHeaderName(i) << ": " << getHeaderValue(i) << std::endl;
 	}
 
 	// Check if Content-Type suggests binary data
-	std::map<std::string, std::string>::const_iterator contentType = _headers.find("content-type");
-	bool isBinary = (contentType != _headers.end() &&
-		(contentType->second.find("image/") != std::string::npos ||
-		 contentType->second.find("application/octet-stream") != std::string::npos ||
-		 contentType->second.find("audio/") != std::string::npos ||
-		 contentType->second.find("video/") != std::string::npos));
+	std::string contentType = getHeader(H_CONTENT_TYPE);
+	bool isBinary = (contentType.find("image/") != std::string::npos ||
+					 contentType.find("application/octet-stream") != std::string::npos ||
+					 contentType.find("audio/") != std::string::npos ||
+					 contentType.find("video/") != std::string::npos);
 
 	// Also check for null bytes in the body as a fallback detection method
 	if (!isBinary && _body.find('\0') != std::string::npos) {
@@ -693,11 +809,10 @@ void HttpRequest::printRequestDBG() const
 	}
 }
 
-const std::string &HttpRequest::getHostName() const
+std::string HttpRequest::getHostName() const
 {
-	std::map<std::string, std::string>::const_iterator it = _headers.find("host");
-	if (it != _headers.end())
-		return it->second;
+	if (hasHeader(H_HOST))
+		return getHeader(H_HOST);
 	else
 		return kDefaultServerName;
 }
@@ -709,14 +824,10 @@ const std::string &HttpRequest::getTarget() const
 
 bool HttpRequest::isKeepAlive() const
 {
-	std::map<std::string, std::string>::const_iterator it = _headers.find("connection");
-	if (it != _headers.end())
-	{
-		if (it->second == "close")
-			return false;
-		else if (it->second == "keep-alive")
-			return true;
-	}
+	if (isHeaderEqual(H_CONNECTION, "close"))
+		return false;
+	else if (isHeaderEqual(H_CONNECTION, "keep-alive"))
+		return true;
 	return kDefaultKeepAlive;
 }
 
@@ -740,15 +851,39 @@ const std::string &HttpRequest::getQuery() const
 	return _query;
 }
 
-const std::map<std::string, std::string> &HttpRequest::getHeaders() const
+size_t HttpRequest::getHeaderCount() const
+{
+	return _fields.size();
+}
+
+std::string HttpRequest::getHeaderName(size_t index) const
+{
+	return _headerData.substr(_fields[index].nameOffset, _fields[index].nameLength);
+}
+
+std::string HttpRequest::getHeaderValue(size_t index) const
+{
+	return _headerData.substr(_fields[index].valueOffset, _fields[index].valueLength);
+}
+
+bool HttpRequest::hasHeader(HeaderId id) const
+{
+	return _knownFields[id] != -1;
+}
+
+// Value of a well-known header, empty if the request doesn't have it
+std::string HttpRequest::getHeader(HeaderId id) const
 {
-	return _headers;
+	if (_knownFields[id] == -1)
+		return std::string();
+	return getHeaderValue(_knownFields[id]);
 }
 
-const std::string &HttpRequest::getHeaderValue(const std::string key) const
+// Compares a well-known header to value without copying it out of the buffer
+bool HttpRequest::isHeaderEqual(HeaderId id, const char *value) const
 {
-	std::map<std::string, std::string>::const_iterator it = _headers.find(key);
-	if (it != _headers.end())
-		return it->second;
-	throw std::runtime_error("Header not found");
+	if (_knownFields[id] == -1)
+		return false;
+	const HeaderField &field = _fields[_knownFields[id]];
+	return _headerData.compare(field.valueOffset, field.valueLength, value) == 0;
 }
@@ -1,12 +1,21 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <vector>
 #include "Consts.hpp"
 
 class Server;
 class Location;
 
+// One header line, name (lower case) and value are ranges of the request's header buffer
+struct HeaderField
+{
+	size_t nameOffset;
+	size_t nameLength;
+	size_t valueOffset;
+	size_t valueLength;
+};
+
 class HttpRequest
 {
 public:
@@ -17,20 +26,25 @@ public:
 
 	// // Getters
 	RequestState getState() const;
-	const std::string &getHostName() const;
+	std::string getHostName() const;
 	const std::string &getTarget() const;
 	const std::string &getVersion() const;
 	const std::string &getMethod() const;
 	const std::string &getBody() const;
 	const std::string &getQuery() const;
-	const std::map<std::string, std::string> &getHeaders() const;
-	const std::string &getHeaderValue(const std::string key) const;
+	size_t getHeaderCount() const;
+	std::string getHeaderName(size_t index) const;
+	std::string getHeaderValue(size_t index) const;
+	bool hasHeader(HeaderId id) const;
+	std::string getHeader(HeaderId id) const;
+	bool isHeaderEqual(HeaderId id, const char *value) const;
 	bool isKeepAlive() const;
 
 	// // Setters
 	void setState(RequestState state);
 
-	void parseRequest(const std::string &raw);
+	std::size_t parseRequest(const char *data, std::size_t len);
+	void reset();
 	void printRequestDBG() const;
 
 private:
@@ -39,13 +53,15 @@ private:
 	std::string _target;
 	std::string _query;
 	std::string _version;
-	std::map<std::string, std::string> _headers;
+	std::string _headerData; // names and values of all the header lines, back to back
+	std::vector<HeaderField> _fields; // in arrival order
+	int _knownFields[H_KNOWN_COUNT]; // index in _fields, -1 when absent
+	size_t _fieldStart; // offset of the header line being parsed
+	size_t _valueStart; // offset of its value
 	std::string _body;
 	int _headerLength;
 	int _clientHeaderBufferSize;
 	size_t _clientMaxBodySize; // TODO: check that we enforce this limit
-	std::string _currentHeaderName;
-	std::string _currentHeaderValue;
 	size_t _expectedBodyLength;
 	bool _isChunked; // true if transfer-encoding is chunked
 
@@ -75,5 +91,7 @@ private:
 	void parseHexEnd(unsigned char c);
 	void parseChunk(unsigned char c);
 	void parseChunkEnd(unsigned char c);
-	void parseBody(unsigned char c);
+	std::size_t parseHeaderSpan(const char *data, std::size_t len);
+	void addHeaderField();
+	std::size_t parseBodySpan(const char *data, std::size_t len);
 };
@@ -1,49 +1,247 @@
-#include <sstream>
 #include <fstream>
 #include <iostream>
+#include <unistd.h>
+#include <cstring>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
 #include "HttpResponse.hpp"
 #include "Consts.hpp"
 #include "StringUtils.hpp"
+#include "FileUtils.hpp"
+#include "HeaderCache.hpp"
 
-HttpResponse::HttpResponse() : _response("")
+static const char *memoryBytes(const ResponseSegment &segment)
 {
+	if (segment.shared != NULL)
+		return segment.shared->data();
+	return segment.view != NULL ? segment.view : segment.data.data();
 }
 
-HttpResponse::HttpResponse(const HttpResponse &src) : _response(src._response)
+static size_t memorySize(const ResponseSegment &segment)
 {
+	if (segment.shared != NULL)
+		return segment.shared->size();
+	return segment.view != NULL ? segment.length : segment.data.size();
+}
+
+HttpResponse::HttpResponse() : _segments(), _sent(0)
+{
+}
+
+// File descriptors are duplicated so that each copy owns (and closes) its own,
+// shared buffers get one more reference
+HttpResponse::HttpResponse(const HttpResponse &src) : _segments(src._segments),
+													  _sent(src._sent)
+{
+	for (std::deque<ResponseSegment>::iterator it = _segments.begin(); it != _segments.end(); ++it)
+	{
+		if (it->fd != -1)
+			it->fd = dup(it->fd);
+		if (it->shared != NULL)
+			it->shared->retain();
+	}
 }
 
 HttpResponse &HttpResponse::operator=(const HttpResponse &src)
 {
 	if (this != &src)
 	{
-		_response = src._response;
+		clear();
+		_segments = src._segments;
+		_sent = src._sent;
+		for (std::deque<ResponseSegment>::iterator it = _segments.begin(); it != _segments.end(); ++it)
+		{
+			if (it->fd != -1)
+				it->fd = dup(it->fd);
+			if (it->shared != NULL)
+				it->shared->retain();
+		}
 	}
 	return *this;
 }
 
 HttpResponse::~HttpResponse()
 {
+	clear();
 }
 
-void HttpResponse::setResponse(const std::string &response)
+void HttpResponse::clear()
 {
-	_response = response;
+	for (std::deque<ResponseSegment>::iterator it = _segments.begin(); it != _segments.end(); ++it)
+	{
+		closeFd(it->fd);
+		if (it->shared != NULL)
+			it->shared->release();
+	}
+	_segments.clear();
+	_sent = 0;
 }
 
-const std::string &HttpResponse::getResponse() const
+void HttpResponse::appendResponse(const std::string &data)
 {
-	return _response;
+	std::string copy(data);
+	appendResponseData(copy);
 }
 
-void HttpResponse::eraseResponse(int nbytes)
+void HttpResponse::appendResponseData(std::string &data)
 {
-	_response.erase(0, nbytes);
+	if (data.empty())
+		return;
+	_segments.push_back(ResponseSegment());
+	ResponseSegment &segment = _segments.back();
+	segment.data.swap(data);
+	segment.view = NULL;
+	segment.shared = NULL;
+	segment.fd = -1;
+	segment.offset = 0;
+	segment.length = 0;
 }
 
-void HttpResponse::appendResponse(const std::string &data)
+void HttpResponse::appendResponseView(const char *data, size_t length)
+{
+	if (length == 0)
+		return;
+	_segments.push_back(ResponseSegment());
+	ResponseSegment &segment = _segments.back();
+	segment.view = data;
+	segment.shared = NULL;
+	segment.fd = -1;
+	segment.offset = 0;
+	segment.length = length;
+}
+
+void HttpResponse::appendResponseShared(SharedBuffer *buffer)
+{
+	if (buffer->size() == 0)
+		return;
+	buffer->retain();
+	_segments.push_back(ResponseSegment());
+	ResponseSegment &segment = _segments.back();
+	segment.view = NULL;
+	segment.shared = buffer;
+	segment.fd = -1;
+	segment.offset = 0;
+	segment.length = 0;
+}
+
+void HttpResponse::appendFileBody(int fd, off_t offset, size_t length)
+{
+	if (length == 0)
+	{
+		closeFd(fd);
+		return;
+	}
+	_segments.push_back(ResponseSegment());
+	ResponseSegment &segment = _segments.back();
+	segment.view = NULL;
+	segment.shared = NULL;
+	segment.fd = fd;
+	segment.offset = offset;
+	segment.length = length;
+}
+
+bool HttpResponse::isComplete() const
 {
-	_response += data;
+	return _segments.empty();
+}
+
+ssize_t HttpResponse::sendResponse(int sockFd)
+{
+	// Keep going while the socket takes whole segments, so the responses of
+	// pipelined requests leave together instead of one per event
+	ssize_t sent = 0;
+	while (!_segments.empty())
+	{
+		bool complete = false;
+		ssize_t nbytes;
+		if (_segments.front().fd != -1)
+			nbytes = sendFrontFile(sockFd, complete);
+		else
+			nbytes = sendFrontMemory(sockFd, complete);
+		if (nbytes == 0)
+			return 0;
+		if (nbytes < 0)
+			return sent > 0 ? sent : nbytes; // a real error shows up again at the next call
+		sent += nbytes;
+		if (!complete)
+			break;
+	}
+	return sent;
+}
+
+// Gather the consecutive memory segments at the front in a single sendmsg()
+ssize_t HttpResponse::sendFrontMemory(int sockFd, bool &complete)
+{
+	struct iovec iov[kMaxIovecs];
+	int iovcnt = 0;
+	size_t total = 0;
+	for (std::deque<ResponseSegment>::iterator it = _segments.begin();
+		 it != _segments.end() && it->fd == -1 && iovcnt < kMaxIovecs; ++it)
+	{
+		size_t skip = (iovcnt == 0) ? _sent : 0;
+		iov[iovcnt].iov_base = const_cast<char *>(memoryBytes(*it)) + skip;
+		iov[iovcnt].iov_len = memorySize(*it) - skip;
+		total += iov[iovcnt].iov_len;
+		++iovcnt;
+	}
+	// When a file follows (static response header), MSG_MORE lets the kernel
+	// merge the header with the first file bytes instead of sending a small
+	// packet that Nagle then holds back until the client's delayed ACK
+	bool fileFollows = static_cast<size_t>(iovcnt) < _segments.size() && _segments[iovcnt].fd != -1;
+	struct msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+	ssize_t nbytes = sendmsg(sockFd, &msg, fileFollows ? MSG_MORE : 0);
+	if (nbytes <= 0)
+		return nbytes;
+	consume(nbytes);
+	complete = static_cast<size_t>(nbytes) == total;
+	return nbytes;
+}
+
+// Send the front file segment straight from the page cache to the socket
+ssize_t HttpResponse::sendFrontFile(int sockFd, bool &complete)
+{
+	ResponseSegment &segment = _segments.front();
+	ssize_t nbytes = sendfile(sockFd, segment.fd, &segment.offset, segment.length);
+	if (nbytes <= 0)
+		return nbytes;
+	segment.length -= nbytes;
+	if (segment.length == 0)
+	{
+		popFront();
+		complete = true;
+	}
+	return nbytes;
+}
+
+// Advance the cursor over the memory segments that were sent
+void HttpResponse::consume(size_t nbytes)
+{
+	while (nbytes > 0 && !_segments.empty() && _segments.front().fd == -1)
+	{
+		size_t left = memorySize(_segments.front()) - _sent;
+		if (nbytes < left)
+		{
+			_sent += nbytes;
+			return;
+		}
+		nbytes -= left;
+		popFront();
+		_sent = 0;
+	}
+}
+
+// Drops the front segment with what it holds: its file or its shared buffer reference
+void HttpResponse::popFront()
+{
+	ResponseSegment &segment = _segments.front();
+	closeFd(segment.fd);
+	if (segment.shared != NULL)
+		segment.shared->release();
+	_segments.pop_front();
 }
 
 void HttpResponse::generateErrorResponse(const std::string &statusCode)
@@ -64,16 +262,25 @@ void HttpResponse::generateErrorResponse(const std::string &statusCode)
 										"<hr><center>webserver/1.0</center>\n"
 										"</body>\n"
 										"</html>\n";
-	std::ostringstream oss;
-	oss << "HTTP/1.1 " << statusCode << " " << statusText << "\r\n";
-	oss << "Server: webserver/1.0\r\n";
-	oss << "Date: " << getCurrentTime() << "\r\n";
-	oss << "Content-Type: text/html\r\n";
-	oss << "Content-Length: " << body.length() << "\r\n";
-	oss << "Connection: close\r\n";
-	oss << "\r\n"
-		<< body;
-	_response = oss.str();
+	appendErrorPage(statusCode, body);
+}
+
+// Queues an error page, built in one string sized up front
+void HttpResponse::appendErrorPage(const std::string &statusCode, const std::string &body)
+{
+	const std::string &prefix = getStatusPrefix(statusCode);
+	const std::string &date = getDateHeader();
+	std::string length = numberToString(body.length());
+	std::string response;
+	response.reserve(prefix.size() + date.size() + length.size() + body.size() + 80);
+	response += prefix;
+	response += date;
+	response += "Content-Type: text/html\r\n";
+	response += "Content-Length: ";
+	response += length;
+	response += "\r\nConnection: close\r\n\r\n";
+	response += body;
+	appendResponseData(response);
 }
 
 void HttpResponse::generateErrorResponseFile(const std::string &statusCode, const std::string &filePath)
@@ -88,16 +295,6 @@ void HttpResponse::generateErrorResponseFile(const std::string &statusCode, cons
 	}
 	std::string body((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 	file.close();
-	std::string statusText = kStatusCodes.find(statusCode)->second;
-	std::ostringstream oss;
-	oss << "HTTP/1.1 " << statusCode << " " << statusText << "\r\n";
-	oss << "Server: webserver/1.0\r\n";
-	oss << "Date: " << getCurrentTime() << "\r\n";
-	oss << "Content-Type: text/html\r\n";
-	oss << "Content-Length: " << body.length() << "\r\n";
-	oss << "Connection: close\r\n";
-	oss << "\r\n"
-		<< body;
-	_response = oss.str();
+	appendErrorPage(statusCode, body);
 }
 
@@ -1,7 +1,27 @@
 #pragma once
 
 #include <string>
+#include <deque>
+#include <sys/types.h>
+#include "SharedBuffer.hpp"
 
+// One piece of the outgoing response: either bytes in memory or a file range
+// sent with sendfile(). A file segment owns its file descriptor, memory is
+// owned by the segment (data), borrowed from the connection's arena (view)
+// or referenced from a buffer shared with other responses (shared).
+struct ResponseSegment
+{
+	std::string data;	  // bytes to send, used when fd == -1 and view and shared are NULL
+	const char *view;	  // borrowed bytes to send, length of them in length
+	SharedBuffer *shared; // one reference held until the segment is sent
+	int fd;			  // file to stream from, -1 for a memory segment
+	off_t offset;	  // next file offset to send
+	size_t length;	  // file bytes left to send, or size of view
+};
+
+// The response is a send queue: segments are sent in order and a cursor
+// (_sent) marks how much of the front memory segment already left, so
+// draining a large response costs O(bytes) without shifting or copying it.
 class HttpResponse
 {
 public:
@@ -10,13 +30,32 @@ public:
 	HttpResponse &operator=(const HttpResponse &src);
 	~HttpResponse();
 
-	void setResponse(const std::string &response);
-	const std::string &getResponse() const;
-	void eraseResponse(int nbytes);
+	void appendResponse(const std::string &data);
+	// Same as appendResponse() but steals the content of data instead of copying it
+	void appendResponseData(std::string &data);
+	// Queues bytes without copying them, they must stay valid until sent
+	void appendResponseView(const char *data, size_t length);
+	// Queues the whole buffer and holds a reference to it until sent
+	void appendResponseShared(SharedBuffer *buffer);
+	// Takes ownership of fd and closes it once the range is sent
+	void appendFileBody(int fd, off_t offset, size_t length);
 	void generateErrorResponse(const std::string &statusCode);
 	void generateErrorResponseFile(const std::string &statusCode, const std::string &filePath);
-	void appendResponse(const std::string &data); // New method to append data to the response
+	void clear();
+
+	// Send as much as possible of the queue to sockFd.
+	// Returns the number of bytes sent, -1 on error (like send())
+	// and 0 if a file was truncated after its Content-Length was sent.
+	ssize_t sendResponse(int sockFd);
+	bool isComplete() const;
 
 private:
-	std::string _response;
+	std::deque<ResponseSegment> _segments;
+	size_t _sent; // bytes of the front memory segment already sent
+
+	void consume(size_t nbytes);
+	void popFront();
+	void appendErrorPage(const std::string &statusCode, const std::string &body);
+	ssize_t sendFrontMemory(int sockFd, bool &complete);
+	ssize_t sendFrontFile(int sockFd, bool &complete);
 };
@@ -0,0 +1,82 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h> // for strncasecmp
+#include "HttpUtils.hpp"
+
+// Accepts IMF-fixdate only, a date in another format is ignored like a missing header
+bool parseHttpDate(const std::string &value, time_t &t)
+{
+	struct tm tm;
+	std::memset(&tm, 0, sizeof(tm));
+	const char *end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	if (end == NULL || *end != '\0')
+		return false;
+	t = timegm(&tm);
+	return t != static_cast<time_t>(-1);
+}
+
+// Strong validator from the modification time and the length, like nginx: "mtime-length" in hex
+size_t formatEtag(time_t mtime, off_t length, char *buf, size_t size)
+{
+	int n = snprintf(buf, size, "\"%lx-%lx\"", static_cast<unsigned long>(mtime), static_cast<unsigned long>(length));
+	return (n < 0 || static_cast<size_t>(n) >= size) ? 0 : static_cast<size_t>(n);
+}
+
+// If-None-Match is "*" or a comma separated list of tags, compared weakly (W/ is ignored)
+bool etagMatches(const std::string &ifNoneMatch, const char *etag, size_t etagLength)
+{
+	size_t pos = 0;
+	while (pos < ifNoneMatch.length())
+	{
+		while (pos < ifNoneMatch.length() && (ifNoneMatch[pos] == ' ' || ifNoneMatch[pos] == '\t' || ifNoneMatch[pos] == ','))
+			++pos;
+		size_t end = ifNoneMatch.find(',', pos);
+		if (end == std::string::npos)
+			end = ifNoneMatch.length();
+		size_t last = end;
+		while (last > pos && (ifNoneMatch[last - 1] == ' ' || ifNoneMatch[last - 1] == '\t'))
+			--last;
+		size_t start = pos;
+		if (ifNoneMatch.compare(start, 2, "W/") == 0)
+			start += 2;
+		if (last > start)
+		{
+			if (last - start == 1 && ifNoneMatch[start] == '*')
+				return true;
+			if (last - start == etagLength && ifNoneMatch.compare(start, etagLength, etag) == 0)
+				return true;
+		}
+		pos = end;
+	}
+	return false;
+}
+
+// A coding listed with q=0 is refused, "*" stands for the codings that are not listed
+bool acceptsEncoding(const std::string &acceptEncoding, const char *coding)
+{
+	size_t codingLength = std::strlen(coding);
+	int wildcard = -1; // -1: no "*", 0: "*;q=0", 1: "*"
+	size_t pos = 0;
+	while (pos < acceptEncoding.length())
+	{
+		size_t end = acceptEncoding.find(',', pos);
+		if (end == std::string::npos)
+			end = acceptEncoding.length();
+		while (pos < end && (acceptEncoding[pos] == ' ' || acceptEncoding[pos] == '\t'))
+			++pos;
+		size_t nameEnd = pos;
+		while (nameEnd < end && acceptEncoding[nameEnd] != ';' && acceptEncoding[nameEnd] != ' ' && acceptEncoding[nameEnd] != '\t')
+			++nameEnd;
+		bool accepted = true;
+		size_t q = acceptEncoding.find("q=", nameEnd);
+		if (q < end)
+			accepted = std::strtod(acceptEncoding.c_str() + q + 2, NULL) > 0;
+		if (nameEnd - pos == codingLength && strncasecmp(acceptEncoding.c_str() + pos, coding, codingLength) == 0)
+			return accepted;
+		if (nameEnd - pos == 1 && acceptEncoding[pos] == '*')
+			wildcard = accepted;
+		pos = end + 1;
+	}
+	return wildcard == 1;
+}
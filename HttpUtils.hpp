@@ -0,0 +1,12 @@
+#pragma once
+#include <ctime>
+#include <string>
+#include <sys/types.h>
+
+// Validators of cacheable responses, written to buf like snprintf()
+bool parseHttpDate(const std::string &value, time_t &t);
+size_t formatEtag(time_t mtime, off_t length, char *buf, size_t size);
+bool etagMatches(const std::string &ifNoneMatch, const char *etag, size_t etagLength);
+
+// Content negotiation of precompressed and compressed responses
+bool acceptsEncoding(const std::string &acceptEncoding, const char *coding);
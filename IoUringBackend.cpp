@@ -0,0 +1,323 @@
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include "IoUringBackend.hpp"
+#include "Consts.hpp"
+
+// user_data of the cancel requests, never a valid (generation, fd) pair
+static const uint64_t kRemoveUserData = ~0ULL;
+
+static uint64_t pollUserData(int fd, uint32_t generation)
+{
+	return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+IoUringBackend::IoUringBackend() : _ringFd(-1),
+								   _sqRing(MAP_FAILED),
+								   _sqRingSize(0),
+								   _cqRing(MAP_FAILED),
+								   _cqRingSize(0),
+								   _sqes(static_cast<struct io_uring_sqe *>(MAP_FAILED)),
+								   _sqesSize(0),
+								   _sqHead(NULL),
+								   _sqTail(NULL),
+								   _sqMask(0),
+								   _sqEntries(0),
+								   _cqHead(NULL),
+								   _cqTail(NULL),
+								   _cqMask(0),
+								   _cqes(NULL),
+								   _sqLocalTail(0),
+								   _slots(),
+								   _rearm()
+{
+	setup();
+}
+
+IoUringBackend::~IoUringBackend()
+{
+	release();
+}
+
+const char *IoUringBackend::getName() const
+{
+	return "io_uring";
+}
+
+void IoUringBackend::setup()
+{
+	struct io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CLAMP;
+	_ringFd = syscall(__NR_io_uring_setup, kIoUringEntries, &params);
+	if (_ringFd == -1)
+	{
+		int err = errno;
+		throw std::runtime_error(std::string("io_uring_setup: ") + strerror(err));
+	}
+	// Timeouts in io_uring_enter() need EXT_ARG (5.11), NODROP keeps completions on CQ overflow
+	const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+	if ((params.features & required) != required)
+	{
+		release();
+		throw std::runtime_error("io_uring: kernel is missing required features");
+	}
+
+	// With SINGLE_MMAP the submission and completion rings share one mapping
+	_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (_cqRingSize > _sqRingSize)
+		_sqRingSize = _cqRingSize;
+	_sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				   _ringFd, IORING_OFF_SQ_RING);
+	if (_sqRing == MAP_FAILED)
+	{
+		int err = errno;
+		release();
+		throw std::runtime_error(std::string("io_uring mmap: ") + strerror(err));
+	}
+	_cqRing = _sqRing;
+	_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	_sqes = static_cast<struct io_uring_sqe *>(mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE,
+												   MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES));
+	if (_sqes == MAP_FAILED)
+	{
+		int err = errno;
+		release();
+		throw std::runtime_error(std::string("io_uring mmap: ") + strerror(err));
+	}
+
+	char *sq = static_cast<char *>(_sqRing);
+	_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	_sqEntries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+	// Submission slot i always points to sqe i, entries are filled in ring order
+	unsigned *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	for (unsigned i = 0; i < _sqEntries; ++i)
+		array[i] = i;
+	_sqLocalTail = *_sqTail;
+
+	char *cq = static_cast<char *>(_cqRing);
+	_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+void IoUringBackend::release()
+{
+	if (_sqes != MAP_FAILED)
+		munmap(_sqes, _sqesSize);
+	if (_sqRing != MAP_FAILED)
+		munmap(_sqRing, _sqRingSize);
+	_sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+	_sqRing = MAP_FAILED;
+	_cqRing = MAP_FAILED;
+	// Closing the ring cancels every poll still in flight
+	if (_ringFd != -1 && close(_ringFd) == -1)
+	{
+		int err = errno;
+		std::cerr << "close (" << _ringFd << "): " << strerror(err) << std::endl;
+	}
+	_ringFd = -1;
+}
+
+IoUringBackend::PollSlot &IoUringBackend::getSlot(int fd)
+{
+	if (static_cast<size_t>(fd) >= _slots.size())
+	{
+		PollSlot empty = {0, 0, false, false};
+		_slots.resize(std::max(static_cast<size_t>(fd) + 1, _slots.size() * 2), empty);
+	}
+	return _slots[fd];
+}
+
+int IoUringBackend::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+{
+	return syscall(__NR_io_uring_enter, _ringFd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+unsigned IoUringBackend::pendingSubmissions() const
+{
+	return _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+}
+
+struct io_uring_sqe *IoUringBackend::getSqe()
+{
+	if (pendingSubmissions() >= _sqEntries)
+	{
+		// Submission ring full, hand the queued entries to the kernel now
+		enter(pendingSubmissions(), 0, 0, NULL, 0);
+		if (pendingSubmissions() >= _sqEntries)
+			return NULL;
+	}
+	struct io_uring_sqe *sqe = &_sqes[_sqLocalTail & _sqMask];
+	std::memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+void IoUringBackend::queuePollAdd(int fd)
+{
+	PollSlot &slot = _slots[fd];
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == NULL)
+	{
+		_rearm.push_back(fd); // try again at the next wait()
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = slot.events & ~static_cast<uint32_t>(EPOLLET);
+	if (slot.events & EPOLLET)
+		sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = pollUserData(fd, slot.generation);
+	__atomic_store_n(_sqTail, ++_sqLocalTail, __ATOMIC_RELEASE);
+	slot.armed = true;
+}
+
+void IoUringBackend::queuePollRemove(int fd)
+{
+	PollSlot &slot = _slots[fd];
+	struct io_uring_sqe *sqe = getSqe();
+	slot.armed = false;
+	if (sqe == NULL)
+		return; // its completions will be dropped by the generation check
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = pollUserData(fd, slot.generation);
+	sqe->user_data = kRemoveUserData;
+	__atomic_store_n(_sqTail, ++_sqLocalTail, __ATOMIC_RELEASE);
+}
+
+bool IoUringBackend::add(int fd, uint32_t events)
+{
+	if (fd < 0)
+	{
+		errno = EBADF;
+		return false;
+	}
+	PollSlot &slot = getSlot(fd);
+	if (slot.registered)
+	{
+		errno = EEXIST;
+		return false;
+	}
+	slot.events = events;
+	slot.generation++;
+	slot.registered = true;
+	queuePollAdd(fd);
+	return true;
+}
+
+bool IoUringBackend::modify(int fd, uint32_t events)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _slots.size() || !_slots[fd].registered)
+	{
+		errno = ENOENT;
+		return false;
+	}
+	PollSlot &slot = _slots[fd];
+	if (slot.armed)
+		queuePollRemove(fd);
+	slot.events = events;
+	slot.generation++;
+	queuePollAdd(fd);
+	return true;
+}
+
+bool IoUringBackend::remove(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _slots.size() || !_slots[fd].registered)
+	{
+		errno = ENOENT;
+		return false;
+	}
+	PollSlot &slot = _slots[fd];
+	if (slot.armed)
+		queuePollRemove(fd);
+	slot.generation++;
+	slot.registered = false;
+	return true;
+}
+
+// Moves the available completions to the caller's event array
+int IoUringBackend::reap(struct epoll_event *events, int maxEvents)
+{
+	unsigned head = *_cqHead;
+	unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+	int count = 0;
+	while (head != tail && count < maxEvents)
+	{
+		const struct io_uring_cqe *cqe = &_cqes[head & _cqMask];
+		++head;
+		if (cqe->user_data == kRemoveUserData)
+			continue;
+		int fd = static_cast<int>(cqe->user_data & 0xffffffffULL);
+		uint32_t generation = static_cast<uint32_t>(cqe->user_data >> 32);
+		if (static_cast<size_t>(fd) >= _slots.size())
+			continue;
+		PollSlot &slot = _slots[fd];
+		if (!slot.registered || slot.generation != generation)
+			continue; // completion of a poll that was removed or replaced
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+		{
+			// One-shot poll, or a multishot one the kernel terminated
+			slot.armed = false;
+			_rearm.push_back(fd);
+		}
+		events[count].data.fd = fd;
+		events[count].events = cqe->res < 0 ? static_cast<uint32_t>(EPOLLERR) : static_cast<uint32_t>(cqe->res);
+		++count;
+	}
+	__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+	return count;
+}
+
+int IoUringBackend::wait(struct epoll_event *events, int maxEvents, int timeoutMs)
+{
+	// The polls that fired are armed again now that the caller handled them,
+	// an fd that is still ready completes right away: level-triggered like epoll
+	std::vector<int> rearm;
+	rearm.swap(_rearm);
+	for (size_t i = 0; i < rearm.size(); ++i)
+	{
+		if (_slots[rearm[i]].registered && !_slots[rearm[i]].armed)
+			queuePollAdd(rearm[i]);
+	}
+
+	int count = reap(events, maxEvents);
+	if (count > 0)
+	{
+		// Completions were already there, only flush the queued requests
+		if (pendingSubmissions() > 0)
+			enter(pendingSubmissions(), 0, 0, NULL, 0);
+		return count;
+	}
+
+	// Submit the queued requests and wait in the same syscall
+	unsigned flags = IORING_ENTER_GETEVENTS;
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	void *argp = NULL;
+	size_t argSize = 0;
+	if (timeoutMs >= 0)
+	{
+		ts.tv_sec = timeoutMs / 1000;
+		ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+		std::memset(&arg, 0, sizeof(arg));
+		arg.ts = reinterpret_cast<uint64_t>(&ts);
+		flags |= IORING_ENTER_EXT_ARG;
+		argp = &arg;
+		argSize = sizeof(arg);
+	}
+	if (enter(pendingSubmissions(), 1, flags, argp, argSize) == -1 && errno != ETIME)
+		return -1;
+	return reap(events, maxEvents);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <linux/io_uring.h>
+#include "EventBackend.hpp"
+
+/**
+ * Readiness notifications from an io_uring instance driven with raw syscalls.
+ * Every fd has one IORING_OP_POLL_ADD in flight:
+ * - one-shot for level-triggered interest, re-armed on the next wait() so a
+ *   condition that still holds is reported again, like epoll does;
+ * - multishot for EPOLLET interest, it stays armed and fires on every wakeup.
+ * Registration changes are only queued in the submission ring and go to the
+ * kernel with the next wait(), in the same io_uring_enter() call.
+ */
+class IoUringBackend : public EventBackend
+{
+public:
+	IoUringBackend();
+	~IoUringBackend();
+
+	const char *getName() const;
+	bool add(int fd, uint32_t events);
+	bool modify(int fd, uint32_t events);
+	bool remove(int fd);
+	int wait(struct epoll_event *events, int maxEvents, int timeoutMs);
+
+private:
+	struct PollSlot
+	{
+		uint32_t events;	 // interest mask, EPOLLET selects a multishot poll
+		uint32_t generation; // tags the poll in flight, completions of older polls are dropped
+		bool registered;
+		bool armed; // a poll request is queued or in flight
+	};
+
+	int _ringFd;
+	void *_sqRing;
+	size_t _sqRingSize;
+	void *_cqRing;
+	size_t _cqRingSize;
+	struct io_uring_sqe *_sqes;
+	size_t _sqesSize;
+	unsigned *_sqHead;
+	unsigned *_sqTail;
+	unsigned _sqMask;
+	unsigned _sqEntries;
+	unsigned *_cqHead;
+	unsigned *_cqTail;
+	unsigned _cqMask;
+	struct io_uring_cqe *_cqes;
+	unsigned _sqLocalTail; // next free submission slot, published on each queued entry
+	std::vector<PollSlot> _slots; // index: file descriptor
+	std::vector<int> _rearm;	  // fds whose poll completed and must be armed again
+
+	IoUringBackend(const IoUringBackend &other);
+	IoUringBackend &operator=(const IoUringBackend &other);
+
+	void setup();
+	void release();
+	PollSlot &getSlot(int fd);
+	struct io_uring_sqe *getSqe();
+	unsigned pendingSubmissions() const;
+	int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize);
+	void queuePollAdd(int fd);
+	void queuePollRemove(int fd);
+	int reap(struct epoll_event *events, int maxEvents);
+};
@@ -2,53 +2,95 @@
 #include "Consts.hpp"
 
 Location::Location() : _path(""),
+					   _modifier(LOC_PREFIX),
 					   _allowedMethods(kDefaultAllowedMethods),
 					   _root(kDefaultRoot),
 					   _index(kDefaultIndex.begin(), kDefaultIndex.end()),
 					   _autoindex(kDefaultAutoindex),
 					   _returnDirective(),
 					   _uploadDirectory(""),
+					   _expiresMode(EXPIRES_OFF),
+					   _expiresSeconds(0),
+					   _gzipStatic(false),
+					   _gzip(false),
+					   _gzipMinLength(kDefaultGzipMinLength),
+					   _gzipTypes(),
+					   _fastcgiPass(""),
 					   // Initialize all flags to false
 					   _allowedMethodsSet(false),
 					   _rootSet(false),
 					   _indexSet(false),
 					   _autoindexSet(false),
 					   _returnDirectiveSet(false),
-					   _uploadDirectorySet(false)
+					   _uploadDirectorySet(false),
+					   _expiresSet(false),
+					   _gzipStaticSet(false),
+					   _gzipSet(false),
+					   _gzipMinLengthSet(false),
+					   _gzipTypesSet(false),
+					   _fastcgiPassSet(false)
 {
 }
 
 Location::Location(const std::string &path) : _path(path),
+											  _modifier(LOC_PREFIX),
 											  _allowedMethods(kDefaultAllowedMethods),
 											  _root(kDefaultRoot),
 											  _index(kDefaultIndex.begin(), kDefaultIndex.end()),
 											  _autoindex(kDefaultAutoindex),
 											  _returnDirective(),
 											  _uploadDirectory(""),
+											  _expiresMode(EXPIRES_OFF),
+											  _expiresSeconds(0),
+											  _gzipStatic(false),
+											  _gzip(false),
+											  _gzipMinLength(kDefaultGzipMinLength),
+											  _gzipTypes(),
+											  _fastcgiPass(""),
 											  // Initialize all flags to false
 											  _allowedMethodsSet(false),
 											  _rootSet(false),
 											  _indexSet(false),
 											  _autoindexSet(false),
 											  _returnDirectiveSet(false),
-											  _uploadDirectorySet(false)
+											  _uploadDirectorySet(false),
+											  _expiresSet(false),
+											  _gzipStaticSet(false),
+											  _gzipSet(false),
+											  _gzipMinLengthSet(false),
+											  _gzipTypesSet(false),
+											  _fastcgiPassSet(false)
 {
 }
 
 Location::Location(const Location &other) : _path(other._path),
+											_modifier(other._modifier),
 											_allowedMethods(other._allowedMethods),
 											_root(other._root),
 											_index(other._index),
 											_autoindex(other._autoindex),
 											_returnDirective(other._returnDirective),
 											_uploadDirectory(other._uploadDirectory),
+											_expiresMode(other._expiresMode),
+											_expiresSeconds(other._expiresSeconds),
+											_gzipStatic(other._gzipStatic),
+											_gzip(other._gzip),
+											_gzipMinLength(other._gzipMinLength),
+											_gzipTypes(other._gzipTypes),
+											_fastcgiPass(other._fastcgiPass),
 											// Copy all "isSet" flags
 											_allowedMethodsSet(other._allowedMethodsSet),
 											_rootSet(other._rootSet),
 											_indexSet(other._indexSet),
 											_autoindexSet(other._autoindexSet),
 											_returnDirectiveSet(other._returnDirectiveSet),
-											_uploadDirectorySet(other._uploadDirectorySet)
+											_uploadDirectorySet(other._uploadDirectorySet),
+											_expiresSet(other._expiresSet),
+											_gzipStaticSet(other._gzipStaticSet),
+											_gzipSet(other._gzipSet),
+											_gzipMinLengthSet(other._gzipMinLengthSet),
+											_gzipTypesSet(other._gzipTypesSet),
+											_fastcgiPassSet(other._fastcgiPassSet)
 {
 }
 
@@ -57,12 +99,20 @@ Location &Location::operator=(const Location &other)
 	if (this != &other)
 	{
 		_path = other._path;
+		_modifier = other._modifier;
 		_allowedMethods = other._allowedMethods;
 		_root = other._root;
 		_index = other._index;
 		_autoindex = other._autoindex;
 		_returnDirective = other._returnDirective;
 		_uploadDirectory = other._uploadDirectory;
+		_expiresMode = other._expiresMode;
+		_expiresSeconds = other._expiresSeconds;
+		_gzipStatic = other._gzipStatic;
+		_gzip = other._gzip;
+		_gzipMinLength = other._gzipMinLength;
+		_gzipTypes = other._gzipTypes;
+		_fastcgiPass = other._fastcgiPass;
 		// Copy all "isSet" flags
 		_allowedMethodsSet = other._allowedMethodsSet;
 		_rootSet = other._rootSet;
@@ -70,6 +120,12 @@ Location &Location::operator=(const Location &other)
 		_autoindexSet = other._autoindexSet;
 		_returnDirectiveSet = other._returnDirectiveSet;
 		_uploadDirectorySet = other._uploadDirectorySet;
+		_expiresSet = other._expiresSet;
+		_gzipStaticSet = other._gzipStaticSet;
+		_gzipSet = other._gzipSet;
+		_gzipMinLengthSet = other._gzipMinLengthSet;
+		_gzipTypesSet = other._gzipTypesSet;
+		_fastcgiPassSet = other._fastcgiPassSet;
 	}
 	return *this;
 }
@@ -89,6 +145,16 @@ const std::string &Location::getPath() const
 	return _path;
 }
 
+void Location::setModifier(LocationModifier modifier)
+{
+	_modifier = modifier;
+}
+
+LocationModifier Location::getModifier() const
+{
+	return _modifier;
+}
+
 void Location::addAllowedMethod(const std::string &method)
 {
 	if (!_allowedMethodsSet)
@@ -181,6 +247,92 @@ bool Location::isReturnDirectiveSet() const
 	return _returnDirectiveSet;
 }
 
+void Location::setExpires(ExpiresMode mode, long seconds)
+{
+	_expiresMode = mode;
+	_expiresSeconds = seconds;
+	_expiresSet = true;
+}
+
+ExpiresMode Location::getExpiresMode() const
+{
+	return _expiresMode;
+}
+
+long Location::getExpiresSeconds() const
+{
+	return _expiresSeconds;
+}
+
+bool Location::isExpiresSet() const
+{
+	return _expiresSet;
+}
+
+void Location::setGzipStatic(bool gzipStatic)
+{
+	_gzipStatic = gzipStatic;
+	_gzipStaticSet = true;
+}
+
+bool Location::getGzipStatic() const
+{
+	return _gzipStatic;
+}
+
+bool Location::isGzipStaticSet() const
+{
+	return _gzipStaticSet;
+}
+
+void Location::setGzip(bool gzip)
+{
+	_gzip = gzip;
+	_gzipSet = true;
+}
+
+bool Location::getGzip() const
+{
+	return _gzip;
+}
+
+bool Location::isGzipSet() const
+{
+	return _gzipSet;
+}
+
+void Location::setGzipMinLength(size_t length)
+{
+	_gzipMinLength = length;
+	_gzipMinLengthSet = true;
+}
+
+size_t Location::getGzipMinLength() const
+{
+	return _gzipMinLength;
+}
+
+bool Location::isGzipMinLengthSet() const
+{
+	return _gzipMinLengthSet;
+}
+
+void Location::addGzipType(const std::string &type)
+{
+	_gzipTypes.insert(type);
+	_gzipTypesSet = true;
+}
+
+const std::set<std::string> &Location::getGzipTypes() const
+{
+	return _gzipTypes;
+}
+
+bool Location::isGzipTypesSet() const
+{
+	return _gzipTypesSet;
+}
+
 void Location::setUploadDirectory(const std::string &uploadDir)
 {
 	_uploadDirectory = uploadDir;
@@ -196,3 +348,19 @@ bool Location::isUploadDirectorySet() const
 {
 	return _uploadDirectorySet;
 }
+
+void Location::setFastcgiPass(const std::string &address)
+{
+	_fastcgiPass = address;
+	_fastcgiPassSet = true;
+}
+
+const std::string &Location::getFastcgiPass() const
+{
+	return _fastcgiPass;
+}
+
+bool Location::isFastcgiPassSet() const
+{
+	return _fastcgiPassSet;
+}
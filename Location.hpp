@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "Consts.hpp"
 
 class Location
 {
@@ -18,6 +19,9 @@ public:
 	void setPath(const std::string &path);
 	const std::string &getPath() const;
 
+	void setModifier(LocationModifier modifier);
+	LocationModifier getModifier() const;
+
 	void addAllowedMethod(const std::string &method);
 	const std::map<std::string, bool> &getAllowedMethods() const;
 	bool isAllowedMethodSet() const;
@@ -38,18 +42,51 @@ public:
 	const std::pair<std::string, std::string> &getReturnDirective() const;
 	bool isReturnDirectiveSet() const;
 
+	void setExpires(ExpiresMode mode, long seconds);
+	ExpiresMode getExpiresMode() const;
+	long getExpiresSeconds() const;
+	bool isExpiresSet() const;
+
+	void setGzipStatic(bool gzipStatic);
+	bool getGzipStatic() const;
+	bool isGzipStaticSet() const;
+
+	void setGzip(bool gzip);
+	bool getGzip() const;
+	bool isGzipSet() const;
+
+	void setGzipMinLength(size_t length);
+	size_t getGzipMinLength() const;
+	bool isGzipMinLengthSet() const;
+
+	void addGzipType(const std::string &type);
+	const std::set<std::string> &getGzipTypes() const;
+	bool isGzipTypesSet() const;
+
 	void setUploadDirectory(const std::string &uploadDir);
 	const std::string &getUploadDirectory() const;
 	bool isUploadDirectorySet() const;
 
+	void setFastcgiPass(const std::string &address);
+	const std::string &getFastcgiPass() const;
+	bool isFastcgiPassSet() const;
+
 private:
 	std::string _path;									  // The location's URI pattern (e.g., "/upload")
+	LocationModifier _modifier;							  // Default: LOC_PREFIX, how _path is matched
 	std::map<std::string, bool> _allowedMethods;		  // Optional override for allowed methods
 	std::string _root;									  // Optional override for document root in this location
 	std::set<std::string> _index;						  // Optional override for index files
 	bool _autoindex;									  // Override for autoindex (on/off)
 	std::pair<std::string, std::string> _returnDirective; // Optional return directive (e.g., <"301": "http://example.com/default">)
 	std::string _uploadDirectory;						  // If this location handles uploads, the directory where files are saved
+	ExpiresMode _expiresMode;							  // Default: EXPIRES_OFF
+	long _expiresSeconds;								  // Used with EXPIRES_TIME, may be negative
+	bool _gzipStatic;									  // Default: off, serve file.br / file.gz when accepted
+	bool _gzip;											  // Default: off, compress dynamic responses
+	size_t _gzipMinLength;								  // Default: 20, shorter bodies are sent as they are
+	std::set<std::string> _gzipTypes;					  // MIME types compressed besides text/html, "*" for all
+	std::string _fastcgiPass;							  // "unix:/path" or "host:port" of the FastCGI backend, empty if none
 
 	// Flags to indicate whether each optional field was explicitly set.
 	bool _allowedMethodsSet;
@@ -58,4 +95,10 @@ private:
 	bool _autoindexSet;
 	bool _returnDirectiveSet;
 	bool _uploadDirectorySet;
+	bool _expiresSet;
+	bool _gzipStaticSet;
+	bool _gzipSet;
+	bool _gzipMinLengthSet;
+	bool _gzipTypesSet;
+	bool _fastcgiPassSet;
 };
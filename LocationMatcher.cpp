@@ -0,0 +1,201 @@
+#include "LocationMatcher.hpp"
+#include "StringUtils.hpp"
+#include "Consts.hpp"
+
+LocationMatcher::LocationMatcher() : _exact(),
+									 _exactCount(0),
+									 _regexLocations(),
+									 _tree()
+{
+}
+
+LocationMatcher::LocationMatcher(const LocationMatcher &other) : _exact(),
+																 _exactCount(0),
+																 _regexLocations(),
+																 _tree()
+{
+	copyFrom(other);
+}
+
+LocationMatcher &LocationMatcher::operator=(const LocationMatcher &other)
+{
+	if (this != &other)
+	{
+		release();
+		copyFrom(other);
+	}
+	return *this;
+}
+
+LocationMatcher::~LocationMatcher()
+{
+	release();
+}
+
+// Shallow copy of the Location pointers, like LocationTrie
+void LocationMatcher::copyFrom(const LocationMatcher &other)
+{
+	_exact = other._exact;
+	_exactCount = other._exactCount;
+	_regexLocations = other._regexLocations;
+	if (!other._tree.empty())
+		compile();
+}
+
+void LocationMatcher::release()
+{
+	releaseTree();
+	_exact.clear();
+	_exactCount = 0;
+	_regexLocations.clear();
+}
+
+void LocationMatcher::releaseTree()
+{
+	for (size_t i = 0; i < _tree.size(); ++i)
+	{
+		if (_tree[i].regex != NULL)
+		{
+			regfree(_tree[i].regex);
+			delete _tree[i].regex;
+		}
+	}
+	_tree.clear();
+}
+
+void LocationMatcher::placeExact(Location *loc)
+{
+	size_t hash = hashBytes(loc->getPath().data(), loc->getPath().size());
+	size_t mask = _exact.size() - 1;
+	size_t i = hash & mask;
+	while (_exact[i].location != NULL)
+		i = (i + 1) & mask;
+	_exact[i].hash = hash;
+	_exact[i].location = loc;
+}
+
+// Duplicates are rejected by the config parser before they get here
+void LocationMatcher::insertExact(Location *loc)
+{
+	if ((_exactCount + 1) * 2 > _exact.size())
+	{
+		std::vector<ExactSlot> old;
+		old.swap(_exact);
+		ExactSlot empty = {0, NULL};
+		_exact.assign(old.empty() ? kExactLocationTableMinSize : old.size() * 2, empty);
+		for (size_t i = 0; i < old.size(); ++i)
+		{
+			if (old[i].location != NULL)
+				placeExact(old[i].location);
+		}
+	}
+	placeExact(loc);
+	++_exactCount;
+}
+
+void LocationMatcher::insertRegex(Location *loc)
+{
+	_regexLocations.push_back(loc);
+	releaseTree(); // compile() has to run again
+}
+
+size_t LocationMatcher::buildNode(size_t begin, size_t end)
+{
+	std::string pattern = _regexLocations[begin]->getPath();
+	if (end - begin > 1)
+	{
+		pattern = '(' + pattern + ')';
+		for (size_t i = begin + 1; i < end; ++i)
+			pattern += "|(" + _regexLocations[i]->getPath() + ')';
+	}
+	RegexNode node = {begin, end, new regex_t, 0, 0};
+	// A pattern that only parses on its own, like one with an unmatched ')', breaks the alternation
+	if (regcomp(node.regex, pattern.c_str(), REG_EXTENDED | REG_NOSUB) != 0)
+	{
+		delete node.regex;
+		node.regex = NULL;
+	}
+	size_t index = _tree.size();
+	_tree.push_back(node);
+	if (end - begin > 1)
+	{
+		size_t middle = begin + (end - begin) / 2;
+		size_t left = buildNode(begin, middle);
+		size_t right = buildNode(middle, end);
+		_tree[index].left = left;
+		_tree[index].right = right;
+	}
+	return index;
+}
+
+void LocationMatcher::compile()
+{
+	releaseTree();
+	if (!_regexLocations.empty())
+		buildNode(0, _regexLocations.size());
+}
+
+Location *LocationMatcher::findExact(const std::string &uri) const
+{
+	if (_exactCount == 0)
+		return NULL;
+	size_t hash = hashBytes(uri.data(), uri.size());
+	size_t mask = _exact.size() - 1;
+	for (size_t i = hash & mask; _exact[i].location != NULL; i = (i + 1) & mask)
+	{
+		if (_exact[i].hash == hash && _exact[i].location->getPath() == uri)
+			return _exact[i].location;
+	}
+	return NULL;
+}
+
+// Index of the first regex of the node that matches uri, _regexLocations.size() if none does.
+// matches is true when the caller already knows that one of them does
+size_t LocationMatcher::firstMatch(size_t index, const char *uri, bool matches) const
+{
+	const RegexNode &node = _tree[index];
+	if (!matches && node.regex != NULL)
+	{
+		if (regexec(node.regex, uri, 0, NULL, 0) != 0)
+			return _regexLocations.size();
+		matches = true;
+	}
+	if (node.end - node.begin == 1)
+		return matches ? node.begin : _regexLocations.size();
+	size_t found = firstMatch(node.left, uri, false);
+	if (found != _regexLocations.size())
+		return found;
+	return firstMatch(node.right, uri, matches);
+}
+
+Location *LocationMatcher::findRegex(const std::string &uri) const
+{
+	if (_tree.empty())
+		return NULL;
+	size_t found = firstMatch(0, uri.c_str(), false);
+	if (found == _regexLocations.size())
+		return NULL;
+	return _regexLocations[found];
+}
+
+bool LocationMatcher::hasRegex(const std::string &pattern) const
+{
+	for (size_t i = 0; i < _regexLocations.size(); ++i)
+	{
+		if (_regexLocations[i]->getPath() == pattern)
+			return true;
+	}
+	return false;
+}
+
+std::vector<Location *> LocationMatcher::getAllLocations() const
+{
+	std::vector<Location *> locations;
+	for (size_t i = 0; i < _exact.size(); ++i)
+	{
+		if (_exact[i].location != NULL)
+			locations.push_back(_exact[i].location);
+	}
+	locations.insert(locations.end(), _regexLocations.begin(), _regexLocations.end());
+	return locations;
+}
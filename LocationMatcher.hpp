@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <regex.h>
+#include "Location.hpp"
+
+/**
+ * The "location = /path" and "location ~ regex" blocks of a server, the
+ * prefix ones stay in the LocationTrie. Exact paths are hashed, so finding
+ * one costs a pass over the target whatever the number of blocks.
+ * The regexes are compiled into a binary tree of alternations: the root
+ * joins all of them, so a single regexec() tells whether any matches, and
+ * the first one in config order is found by going down the tree, one
+ * regexec() on a half of the remaining regexes per level.
+ */
+class LocationMatcher
+{
+public:
+	LocationMatcher();
+	// Copies compile their own tree, a regex_t can't be duplicated
+	LocationMatcher(const LocationMatcher &other);
+	LocationMatcher &operator=(const LocationMatcher &other);
+	~LocationMatcher();
+
+	void insertExact(Location *loc);
+	// The path of loc must pass isValidRegex()
+	void insertRegex(Location *loc);
+	// Builds the regex tree, called once the locations are known
+	void compile();
+
+	Location *findExact(const std::string &uri) const;
+	// First regex in config order that matches uri, NULL if none does
+	Location *findRegex(const std::string &uri) const;
+	bool hasRegex(const std::string &pattern) const;
+	std::vector<Location *> getAllLocations() const;
+
+private:
+	struct ExactSlot
+	{
+		size_t hash;
+		Location *location; // NULL when the slot is free
+	};
+
+	// Alternation of the regexes [begin, end), a leaf when it holds only one
+	struct RegexNode
+	{
+		size_t begin; // in _regexLocations
+		size_t end;
+		regex_t *regex; // NULL if the alternation didn't compile, the halves are tried instead
+		size_t left;	// in _tree, unused by leaves
+		size_t right;
+	};
+
+	std::vector<ExactSlot> _exact; // power of two, at most half full
+	size_t _exactCount;
+	std::vector<Location *> _regexLocations; // in config order
+	std::vector<RegexNode> _tree;			 // _tree[0] is the root, empty until compile()
+
+	void copyFrom(const LocationMatcher &other);
+	void release();
+	void releaseTree();
+	void placeExact(Location *loc);
+	size_t buildNode(size_t begin, size_t end);
+	size_t firstMatch(size_t index, const char *uri, bool matches) const;
+};
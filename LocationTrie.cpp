@@ -1,3 +1,4 @@
+#include <cstring>
 #include "LocationTrie.hpp"
 
 // ----------------------
@@ -57,7 +58,7 @@ LocationTrieNode::~LocationTrieNode()
 // LocationTrie methods
 // ----------------------
 
-LocationTrie::LocationTrie()
+LocationTrie::LocationTrie() : _nodes(), _labels(), _edgeChars(), _compiled(false)
 {
 	root = new LocationTrieNode();
 }
@@ -71,7 +72,10 @@ LocationTrieNode *LocationTrie::copyNode(const LocationTrieNode *node)
 	return newNode;
 }
 
-LocationTrie::LocationTrie(const LocationTrie &other)
+LocationTrie::LocationTrie(const LocationTrie &other) : _nodes(other._nodes),
+														_labels(other._labels),
+														_edgeChars(other._edgeChars),
+														_compiled(other._compiled)
 {
 	root = copyNode(other.root);
 }
@@ -82,6 +86,10 @@ LocationTrie &LocationTrie::operator=(const LocationTrie &other)
 	{
 		delete root;
 		root = copyNode(other.root);
+		_nodes = other._nodes;
+		_labels = other._labels;
+		_edgeChars = other._edgeChars;
+		_compiled = other._compiled;
 	}
 	return *this;
 }
@@ -109,14 +117,79 @@ void LocationTrie::insert(Location *loc)
 	}
 	node->isEnd = true;
 	node->location = loc;
+	_compiled = false;
+}
+
+void LocationTrie::compile()
+{
+	_nodes.clear();
+	_labels.clear();
+	_edgeChars.clear();
+	RadixNode top = {0, 0, 0, 0, NULL};
+	_nodes.push_back(top);
+	_edgeChars += '\0';
+	compileChildren(root, 0);
+	_compiled = true;
+}
+
+// Lays out the children of node after the nodes already placed, then their own children
+void LocationTrie::compileChildren(const LocationTrieNode *node, size_t index)
+{
+	size_t first = _nodes.size();
+	std::vector<const LocationTrieNode *> ends;
+	for (std::map<char, LocationTrieNode *>::const_iterator it = node->children.begin();
+		 it != node->children.end(); ++it)
+	{
+		RadixNode edge = {_labels.size(), 0, 0, 0, NULL};
+		_labels += it->first;
+		const LocationTrieNode *end = it->second;
+		// A location or a branch ends the label
+		while (!end->isEnd && end->children.size() == 1)
+		{
+			_labels += end->children.begin()->first;
+			end = end->children.begin()->second;
+		}
+		edge.labelLength = _labels.size() - edge.labelStart;
+		edge.location = end->isEnd ? end->location : NULL;
+		_nodes.push_back(edge);
+		_edgeChars += it->first;
+		ends.push_back(end);
+	}
+	_nodes[index].firstChild = first;
+	_nodes[index].childCount = ends.size();
+	for (size_t i = 0; i < ends.size(); ++i)
+		compileChildren(ends[i], first + i);
 }
 
 // Given a URI, traverse the trie to find the longest matching location prefix.
 // Returns the pointer to the Location if found; otherwise, returns NULL.
 Location *LocationTrie::searchLongestPrefix(const std::string &uri) const
 {
-	LocationTrieNode *node = root;
 	Location *lastFound = NULL;
+	if (_compiled)
+	{
+		// One label comparison per edge instead of one map lookup per character
+		const RadixNode *radix = &_nodes[0];
+		size_t pos = 0;
+		while (pos < uri.size() && radix->childCount > 0)
+		{
+			const char *edge = static_cast<const char *>(
+				std::memchr(_edgeChars.data() + radix->firstChild, uri[pos], radix->childCount));
+			if (edge == NULL)
+				break;
+			radix = &_nodes[edge - _edgeChars.data()];
+			// Locations end on edge boundaries, a partial label can't reach one
+			if (radix->labelLength > uri.size() - pos ||
+				std::memcmp(_labels.data() + radix->labelStart, uri.data() + pos, radix->labelLength) != 0)
+				break;
+			pos += radix->labelLength;
+			if (radix->location != NULL)
+				lastFound = radix->location;
+		}
+		return lastFound;
+	}
+
+	LocationTrieNode *node = root;
 	for (size_t i = 0; i < uri.size(); ++i)
 	{
 		char c = uri[i];
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include "Location.hpp"
 
 class LocationTrieNode
@@ -32,6 +33,8 @@ public:
 	~LocationTrie();
 
 	void insert(Location *loc);
+	// Builds the radix tree used by searchLongestPrefix(), called once the locations are known
+	void compile();
 
 	// Given a URI, return the Location pointer with the longest matching prefix.
 	// Returns NULL if no match is found.
@@ -39,9 +42,26 @@ public:
 	std::vector<Location *> getAllLocations() const;
 
 private:
+	// A radix tree edge: chains of single-child nodes are merged into one label.
+	// The children of a node are contiguous in _nodes, their first label
+	// characters at the same indexes in _edgeChars
+	struct RadixNode
+	{
+		size_t labelStart; // in _labels
+		size_t labelLength;
+		size_t firstChild; // in _nodes
+		size_t childCount;
+		Location *location; // NULL if no location ends here
+	};
+
 	LocationTrieNode *root;
+	std::vector<RadixNode> _nodes; // _nodes[0] is the root, empty until compile()
+	std::string _labels;
+	std::string _edgeChars;
+	bool _compiled;
 
 	// Helper function to deep copy a trie node
 	static LocationTrieNode *copyNode(const LocationTrieNode *node);
 	void collectLocations(const LocationTrieNode *node, std::vector<Location *> &locations) const;
+	void compileChildren(const LocationTrieNode *node, size_t index);
 };
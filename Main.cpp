@@ -25,7 +25,14 @@ int main(int argc, char *argv[])
 	sa.sa_handler = sigintHandler;
 	sigemptyset(&sa.sa_mask);
 	sa.sa_flags = 0;
-	if (sigaction(SIGINT, &sa, NULL) == -1)
+	if (sigaction(SIGINT, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1)
+	{
+		perror("sigaction");
+		return 1;
+	}
+	// A client closing its socket while we sendfile() to it must not kill the server
+	sa.sa_handler = SIG_IGN;
+	if (sigaction(SIGPIPE, &sa, NULL) == -1)
 	{
 		perror("sigaction");
 		return 1;
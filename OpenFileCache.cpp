@@ -0,0 +1,95 @@
+#include "OpenFileCache.hpp"
+#include "FileUtils.hpp"
+
+OpenFileCache::OpenFileCache() : _entries(),
+								 _lru(),
+								 _maxEntries(0),
+								 _validSeconds(0),
+								 _cacheErrors(false)
+{
+}
+
+// Descriptors are not shared, a copy starts with the same settings and no entries
+OpenFileCache::OpenFileCache(const OpenFileCache &other) : _entries(),
+														   _lru(),
+														   _maxEntries(other._maxEntries),
+														   _validSeconds(other._validSeconds),
+														   _cacheErrors(other._cacheErrors)
+{
+}
+
+OpenFileCache &OpenFileCache::operator=(const OpenFileCache &other)
+{
+	if (this != &other)
+	{
+		clear();
+		_maxEntries = other._maxEntries;
+		_validSeconds = other._validSeconds;
+		_cacheErrors = other._cacheErrors;
+	}
+	return *this;
+}
+
+OpenFileCache::~OpenFileCache()
+{
+	clear();
+}
+
+void OpenFileCache::configure(size_t maxEntries, int validSeconds, bool cacheErrors)
+{
+	clear();
+	_maxEntries = maxEntries;
+	_validSeconds = validSeconds;
+	_cacheErrors = cacheErrors;
+}
+
+bool OpenFileCache::isEnabled() const
+{
+	return _maxEntries > 0;
+}
+
+const OpenFileInfo *OpenFileCache::find(const std::string &path, time_t now)
+{
+	std::map<std::string, Entry>::iterator it = _entries.find(path);
+	if (it == _entries.end())
+		return NULL;
+	if (it->second.validUntil < now)
+	{
+		// Expired, the caller resolves the path again and inserts the fresh result
+		erase(it);
+		return NULL;
+	}
+	_lru.splice(_lru.begin(), _lru, it->second.lru);
+	return &it->second.info;
+}
+
+const OpenFileInfo *OpenFileCache::insert(const std::string &path, const OpenFileInfo &info, time_t now)
+{
+	std::map<std::string, Entry>::iterator it = _entries.find(path);
+	if (it != _entries.end())
+		erase(it);
+	if (info.error != NULL && !_cacheErrors)
+		return NULL;
+	while (_entries.size() >= _maxEntries && !_lru.empty())
+		erase(_entries.find(_lru.back()));
+
+	_lru.push_front(path);
+	Entry &entry = _entries[path];
+	entry.info = info;
+	entry.validUntil = now + _validSeconds;
+	entry.lru = _lru.begin();
+	return &entry.info;
+}
+
+void OpenFileCache::erase(std::map<std::string, Entry>::iterator it)
+{
+	closeFd(it->second.info.fd);
+	_lru.erase(it->second.lru);
+	_entries.erase(it);
+}
+
+void OpenFileCache::clear()
+{
+	while (!_entries.empty())
+		erase(_entries.begin());
+}
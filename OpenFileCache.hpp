@@ -0,0 +1,60 @@
+#pragma once
+#include <map>
+#include <list>
+#include <string>
+#include <ctime>
+#include <sys/types.h>
+
+// What a static request resolved to, see Connection::openStaticFile()
+struct OpenFileInfo
+{
+	std::string path;	// full path, with the index file appended for a directory request
+	int fd;				// open read-only, -1 for a directory, a CGI script or an error
+	off_t size;
+	time_t mtime;
+	ino_t inode;
+	bool isDirectory;
+	const char *error; // status thrown for this path ("403", "404"), NULL on success
+};
+
+/**
+ * Keeps the result of resolving static paths, open file descriptors
+ * included, so a hot file is served without stat() or open().
+ * Entries are trusted for `valid` seconds and then resolved again, the
+ * least recently used one is dropped when the cache is full.
+ * A cached descriptor is never handed out: callers dup() it, so an
+ * eviction can't close a file that is still being sent.
+ */
+class OpenFileCache
+{
+public:
+	OpenFileCache();
+	OpenFileCache(const OpenFileCache &other);
+	OpenFileCache &operator=(const OpenFileCache &other);
+	~OpenFileCache();
+
+	void configure(size_t maxEntries, int validSeconds, bool cacheErrors);
+	bool isEnabled() const;
+
+	// NULL when the path is unknown or its entry expired
+	const OpenFileInfo *find(const std::string &path, time_t now);
+	// Takes ownership of info.fd, returns the cached copy
+	const OpenFileInfo *insert(const std::string &path, const OpenFileInfo &info, time_t now);
+	void clear();
+
+private:
+	struct Entry
+	{
+		OpenFileInfo info;
+		time_t validUntil;
+		std::list<std::string>::iterator lru;
+	};
+
+	std::map<std::string, Entry> _entries;
+	std::list<std::string> _lru; // most recently used first
+	size_t _maxEntries;			 // 0 disables the cache
+	int _validSeconds;
+	bool _cacheErrors;
+
+	void erase(std::map<std::string, Entry>::iterator it);
+};
@@ -0,0 +1,152 @@
+#include "ResponseCache.hpp"
+
+ResponseCache::ResponseCache() : _entries(),
+								 _lru(),
+								 _budget(0),
+								 _maxFileSize(0),
+								 _used(0),
+								 _key(),
+								 _hits(0),
+								 _misses(0),
+								 _evictions(0),
+								 _invalidations(0)
+{
+}
+
+// A copy starts with the same settings and no entries
+ResponseCache::ResponseCache(const ResponseCache &other) : _entries(),
+														   _lru(),
+														   _budget(other._budget),
+														   _maxFileSize(other._maxFileSize),
+														   _used(0),
+														   _key(),
+														   _hits(0),
+														   _misses(0),
+														   _evictions(0),
+														   _invalidations(0)
+{
+}
+
+ResponseCache &ResponseCache::operator=(const ResponseCache &other)
+{
+	if (this != &other)
+	{
+		clear();
+		_budget = other._budget;
+		_maxFileSize = other._maxFileSize;
+	}
+	return *this;
+}
+
+ResponseCache::~ResponseCache()
+{
+	clear();
+}
+
+void ResponseCache::configure(size_t budget, size_t maxFileSize)
+{
+	clear();
+	_budget = budget;
+	_maxFileSize = maxFileSize;
+}
+
+bool ResponseCache::isEnabled() const
+{
+	return _budget > 0;
+}
+
+size_t ResponseCache::getMaxFileSize() const
+{
+	return _maxFileSize;
+}
+
+const std::string &ResponseCache::makeKey(const std::string &path, bool keepAlive)
+{
+	_key.assign(path);
+	_key += '\0';
+	_key += keepAlive ? 'k' : 'c';
+	return _key;
+}
+
+SharedBuffer *ResponseCache::find(const std::string &path, bool keepAlive, const OpenFileInfo &file)
+{
+	std::map<std::string, Entry>::iterator it = _entries.find(makeKey(path, keepAlive));
+	if (it == _entries.end())
+	{
+		++_misses;
+		return NULL;
+	}
+	Entry &entry = it->second;
+	if (entry.mtime != file.mtime || entry.size != file.size || entry.inode != file.inode)
+	{
+		++_invalidations;
+		++_misses;
+		erase(it);
+		return NULL;
+	}
+	++_hits;
+	_lru.splice(_lru.begin(), _lru, entry.lru);
+	return entry.response;
+}
+
+SharedBuffer *ResponseCache::insert(const std::string &path, bool keepAlive, const OpenFileInfo &file, std::string &response)
+{
+	const std::string &key = makeKey(path, keepAlive);
+	size_t cost = response.size() + key.size();
+	if (cost > _budget)
+		return NULL;
+	std::map<std::string, Entry>::iterator it = _entries.find(key);
+	if (it != _entries.end())
+		erase(it);
+	while (_used + cost > _budget && !_lru.empty())
+	{
+		++_evictions;
+		erase(_entries.find(_lru.back()));
+	}
+
+	_lru.push_front(key);
+	Entry &entry = _entries[key];
+	entry.response = SharedBuffer::create(response);
+	entry.mtime = file.mtime;
+	entry.size = file.size;
+	entry.inode = file.inode;
+	entry.cost = cost;
+	entry.lru = _lru.begin();
+	_used += cost;
+	return entry.response;
+}
+
+// Responses still queued on a connection keep their own reference
+void ResponseCache::erase(std::map<std::string, Entry>::iterator it)
+{
+	it->second.response->release();
+	_used -= it->second.cost;
+	_lru.erase(it->second.lru);
+	_entries.erase(it);
+}
+
+void ResponseCache::clear()
+{
+	while (!_entries.empty())
+		erase(_entries.begin());
+}
+
+unsigned long ResponseCache::getHits() const
+{
+	return _hits;
+}
+
+unsigned long ResponseCache::getMisses() const
+{
+	return _misses;
+}
+
+unsigned long ResponseCache::getEvictions() const
+{
+	return _evictions;
+}
+
+unsigned long ResponseCache::getInvalidations() const
+{
+	return _invalidations;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <map>
+#include <list>
+#include <string>
+#include "OpenFileCache.hpp"
+#include "SharedBuffer.hpp"
+
+/**
+ * Complete responses to static files, minus the status line and the Date
+ * header, kept in memory up to a byte budget. A stored response is shared
+ * with the connections it is queued on, so evicting it never cuts a send.
+ * Entries are keyed by resolved path and keep-alive flag, and dropped when
+ * the file's mtime, size or inode no longer match.
+ */
+class ResponseCache
+{
+public:
+	ResponseCache();
+	ResponseCache(const ResponseCache &other);
+	ResponseCache &operator=(const ResponseCache &other);
+	~ResponseCache();
+
+	void configure(size_t budget, size_t maxFileSize);
+	bool isEnabled() const;
+	size_t getMaxFileSize() const;
+
+	// NULL when the response is not stored or the file changed since
+	SharedBuffer *find(const std::string &path, bool keepAlive, const OpenFileInfo &file);
+	// Takes the content of response, NULL if it doesn't fit in the budget
+	SharedBuffer *insert(const std::string &path, bool keepAlive, const OpenFileInfo &file, std::string &response);
+	void clear();
+
+	unsigned long getHits() const;
+	unsigned long getMisses() const;
+	unsigned long getEvictions() const;
+	unsigned long getInvalidations() const;
+
+private:
+	struct Entry
+	{
+		SharedBuffer *response;
+		time_t mtime;
+		off_t size;
+		ino_t inode;
+		size_t cost; // bytes charged to the budget
+		std::list<std::string>::iterator lru;
+	};
+
+	std::map<std::string, Entry> _entries;
+	std::list<std::string> _lru; // most recently used first
+	size_t _budget;				 // 0 disables the cache
+	size_t _maxFileSize;
+	size_t _used;
+	std::string _key; // lookup key, reused to avoid an allocation per request
+	unsigned long _hits;
+	unsigned long _misses;
+	unsigned long _evictions;
+	unsigned long _invalidations;
+
+	const std::string &makeKey(const std::string &path, bool keepAlive);
+	void erase(std::map<std::string, Entry>::iterator it);
+};
@@ -10,9 +10,16 @@ Server::Server() : _listens(),
 				   _errorPages(kDefaultErrorPages),
 				   _allowedMethods(kDefaultAllowedMethods),
 				   _autoindex(kDefaultAutoindex),
+				   _expiresMode(EXPIRES_OFF),
+				   _expiresSeconds(0),
+				   _gzipStatic(false),
+				   _gzip(false),
+				   _gzipMinLength(kDefaultGzipMinLength),
+				   _gzipTypes(),
 				   _cgiBin(),
 				   _returnDirective(),
 				   _locationTrie(),
+				   _locationMatcher(),
 				   // Initialize all "isSet" flags to false
 				   _listensSet(false),
 				   _serverNamesSet(false),
@@ -21,6 +28,11 @@ Server::Server() : _listens(),
 				   _errorPagesSet(),
 				   _allowedMethodsSet(false),
 				   _autoindexSet(false),
+				   _expiresSet(false),
+				   _gzipStaticSet(false),
+				   _gzipSet(false),
+				   _gzipMinLengthSet(false),
+				   _gzipTypesSet(false),
 				   _returnDirectiveSet(false)
 {
 	_listens.insert(kDefaultListen);
@@ -34,9 +46,16 @@ Server::Server(const Server &other) : _listens(other._listens),
 									  _errorPages(other._errorPages),
 									  _allowedMethods(other._allowedMethods),
 									  _autoindex(other._autoindex),
+									  _expiresMode(other._expiresMode),
+									  _expiresSeconds(other._expiresSeconds),
+									  _gzipStatic(other._gzipStatic),
+									  _gzip(other._gzip),
+									  _gzipMinLength(other._gzipMinLength),
+									  _gzipTypes(other._gzipTypes),
 									  _cgiBin(other._cgiBin),
 									  _returnDirective(other._returnDirective),
 									  _locationTrie(other._locationTrie),
+									  _locationMatcher(other._locationMatcher),
 									  // Copy all "isSet" flags
 									  _listensSet(other._listensSet),
 									  _serverNamesSet(other._serverNamesSet),
@@ -45,6 +64,11 @@ Server::Server(const Server &other) : _listens(other._listens),
 									  _errorPagesSet(other._errorPagesSet),
 									  _allowedMethodsSet(other._allowedMethodsSet),
 									  _autoindexSet(other._autoindexSet),
+									  _expiresSet(other._expiresSet),
+									  _gzipStaticSet(other._gzipStaticSet),
+									  _gzipSet(other._gzipSet),
+									  _gzipMinLengthSet(other._gzipMinLengthSet),
+									  _gzipTypesSet(other._gzipTypesSet),
 									  _returnDirectiveSet(other._returnDirectiveSet)
 {
 }
@@ -60,9 +84,16 @@ Server &Server::operator=(const Server &other)
 		_errorPages = other._errorPages;
 		_allowedMethods = other._allowedMethods;
 		_autoindex = other._autoindex;
+		_expiresMode = other._expiresMode;
+		_expiresSeconds = other._expiresSeconds;
+		_gzipStatic = other._gzipStatic;
+		_gzip = other._gzip;
+		_gzipMinLength = other._gzipMinLength;
+		_gzipTypes = other._gzipTypes;
 		_cgiBin = other._cgiBin;
 		_returnDirective = other._returnDirective;
 		_locationTrie = other._locationTrie;
+		_locationMatcher = other._locationMatcher;
 		// Copy all "isSet" flags
 		_listensSet = other._listensSet;
 		_serverNamesSet = other._serverNamesSet;
@@ -71,6 +102,11 @@ Server &Server::operator=(const Server &other)
 		_errorPagesSet = other._errorPagesSet;
 		_allowedMethodsSet = other._allowedMethodsSet;
 		_autoindexSet = other._autoindexSet;
+		_expiresSet = other._expiresSet;
+		_gzipStaticSet = other._gzipStaticSet;
+		_gzipSet = other._gzipSet;
+		_gzipMinLengthSet = other._gzipMinLengthSet;
+		_gzipTypesSet = other._gzipTypesSet;
 		_returnDirectiveSet = other._returnDirectiveSet;
 	}
 	return *this;
@@ -78,7 +114,7 @@ Server &Server::operator=(const Server &other)
 
 Server::~Server()
 {
-	std::vector<Location *> locations = _locationTrie.getAllLocations();
+	std::vector<Location *> locations = getLocations();
 	for (std::vector<Location *>::iterator it = locations.begin();
 		 it != locations.end(); ++it)
 	{
@@ -215,6 +251,92 @@ bool Server::isAutoindexSet() const
 	return _autoindexSet;
 }
 
+void Server::setExpires(ExpiresMode mode, long seconds)
+{
+	_expiresMode = mode;
+	_expiresSeconds = seconds;
+	_expiresSet = true;
+}
+
+ExpiresMode Server::getExpiresMode() const
+{
+	return _expiresMode;
+}
+
+long Server::getExpiresSeconds() const
+{
+	return _expiresSeconds;
+}
+
+bool Server::isExpiresSet() const
+{
+	return _expiresSet;
+}
+
+void Server::setGzipStatic(bool gzipStatic)
+{
+	_gzipStatic = gzipStatic;
+	_gzipStaticSet = true;
+}
+
+bool Server::getGzipStatic() const
+{
+	return _gzipStatic;
+}
+
+bool Server::isGzipStaticSet() const
+{
+	return _gzipStaticSet;
+}
+
+void Server::setGzip(bool gzip)
+{
+	_gzip = gzip;
+	_gzipSet = true;
+}
+
+bool Server::getGzip() const
+{
+	return _gzip;
+}
+
+bool Server::isGzipSet() const
+{
+	return _gzipSet;
+}
+
+void Server::setGzipMinLength(size_t length)
+{
+	_gzipMinLength = length;
+	_gzipMinLengthSet = true;
+}
+
+size_t Server::getGzipMinLength() const
+{
+	return _gzipMinLength;
+}
+
+bool Server::isGzipMinLengthSet() const
+{
+	return _gzipMinLengthSet;
+}
+
+void Server::addGzipType(const std::string &type)
+{
+	_gzipTypes.insert(type);
+	_gzipTypesSet = true;
+}
+
+const std::set<std::string> &Server::getGzipTypes() const
+{
+	return _gzipTypes;
+}
+
+bool Server::isGzipTypesSet() const
+{
+	return _gzipTypesSet;
+}
+
 void Server::addCgiBin(const std::string &ext, const std::string &cgiBin)
 {
 	_cgiBin[ext] = cgiBin;
@@ -249,16 +371,50 @@ void Server::addLocation(Location *loc)
 {
 	if (loc)
 	{
-		_locationTrie.insert(loc);
+		if (loc->getModifier() == LOC_EXACT)
+			_locationMatcher.insertExact(loc);
+		else if (loc->getModifier() == LOC_REGEX)
+			_locationMatcher.insertRegex(loc);
+		else
+			_locationTrie.insert(loc);
 	}
 }
 
+bool Server::hasLocation(LocationModifier modifier, const std::string &path) const
+{
+	if (modifier == LOC_EXACT)
+		return _locationMatcher.findExact(path) != NULL;
+	if (modifier == LOC_REGEX)
+		return _locationMatcher.hasRegex(path);
+	// "location ^~ /a" and "location /a" share the trie node
+	Location *prefix = _locationTrie.searchLongestPrefix(path);
+	return prefix != NULL && prefix->getPath() == path;
+}
+
+void Server::compileLocations()
+{
+	_locationTrie.compile();
+	_locationMatcher.compile();
+}
+
 Location *Server::getLocationForURI(const std::string &uri) const
 {
-	return _locationTrie.searchLongestPrefix(uri);
+	Location *location = _locationMatcher.findExact(uri);
+	if (location != NULL)
+		return location;
+	Location *prefix = _locationTrie.searchLongestPrefix(uri);
+	if (prefix != NULL && prefix->getModifier() == LOC_PREFIX_STOP)
+		return prefix;
+	location = _locationMatcher.findRegex(uri);
+	if (location != NULL)
+		return location;
+	return prefix;
 }
 
 std::vector<Location *> Server::getLocations() const
 {
-	return _locationTrie.getAllLocations();
+	std::vector<Location *> locations = _locationTrie.getAllLocations();
+	std::vector<Location *> matched = _locationMatcher.getAllLocations();
+	locations.insert(locations.end(), matched.begin(), matched.end());
+	return locations;
 }
@@ -5,6 +5,7 @@
 #include <set>
 #include <map>
 #include "LocationTrie.hpp"
+#include "LocationMatcher.hpp"
 
 class Server
 {
@@ -43,6 +44,27 @@ public:
 	bool getAutoindex() const;
 	bool isAutoindexSet() const;
 
+	void setExpires(ExpiresMode mode, long seconds);
+	ExpiresMode getExpiresMode() const;
+	long getExpiresSeconds() const;
+	bool isExpiresSet() const;
+
+	void setGzipStatic(bool gzipStatic);
+	bool getGzipStatic() const;
+	bool isGzipStaticSet() const;
+
+	void setGzip(bool gzip);
+	bool getGzip() const;
+	bool isGzipSet() const;
+
+	void setGzipMinLength(size_t length);
+	size_t getGzipMinLength() const;
+	bool isGzipMinLengthSet() const;
+
+	void addGzipType(const std::string &type);
+	const std::set<std::string> &getGzipTypes() const;
+	bool isGzipTypesSet() const;
+
 	void addCgiBin(const std::string &ext, const std::string &cgiBin);
 	const std::map<std::string, std::string> &getCgiBin() const;
 
@@ -51,9 +73,14 @@ public:
 	bool isReturnDirectiveSet() const;
 
 	void addLocation(Location *loc);
+	// True if a block with the same modifier and path was already added
+	bool hasLocation(LocationModifier modifier, const std::string &path) const;
+	// Freezes the locations into the lookup structures, once the server block is parsed
+	void compileLocations();
 
-	// Search for a Location based on the requested URI (longest prefix match).
-	// Returns a pointer to the matching Location, or NULL if none found.
+	// Search for a Location based on the requested URI: exact match, then
+	// longest prefix if it is "^~", then the first matching regex, then the
+	// longest prefix. Returns a pointer to the matching Location, or NULL if none found.
 	Location *getLocationForURI(const std::string &uri) const;
 	std::vector<Location *> getLocations() const;
 
@@ -65,9 +92,16 @@ private:
 	std::map<int, std::string> _errorPages;				  // e.g., 404->"/404.html", 500/502/503/504->"/50x.html"
 	std::map<std::string, bool> _allowedMethods;		  // Default: GET
 	bool _autoindex;									  // Default: off (false)
+	ExpiresMode _expiresMode;							  // Default: EXPIRES_OFF
+	long _expiresSeconds;								  // Used with EXPIRES_TIME, may be negative
+	bool _gzipStatic;									  // Default: off, serve file.br / file.gz when accepted
+	bool _gzip;											  // Default: off, compress dynamic responses
+	size_t _gzipMinLength;								  // Default: 20, shorter bodies are sent as they are
+	std::set<std::string> _gzipTypes;					  // MIME types compressed besides text/html, "*" for all
 	std::map<std::string, std::string> _cgiBin;			  // Maps file extensions to CGI executables (e.g., ".pl" -> "/usr/bin/perl")
 	std::pair<std::string, std::string> _returnDirective; // e.g., <"301": "http://example.com/default">
 	LocationTrie _locationTrie;							  // Trie for storing Location blocks
+	LocationMatcher _locationMatcher;					  // The "=" and "~" Location blocks
 
 	// Flags to indicate whether each optional field was explicitly set.
 	bool _listensSet;
@@ -77,5 +111,10 @@ private:
 	std::set<int> _errorPagesSet;
 	bool _allowedMethodsSet;
 	bool _autoindexSet;
+	bool _expiresSet;
+	bool _gzipStaticSet;
+	bool _gzipSet;
+	bool _gzipMinLengthSet;
+	bool _gzipTypesSet;
 	bool _returnDirectiveSet;
 };
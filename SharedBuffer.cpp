@@ -0,0 +1,37 @@
+#include "SharedBuffer.hpp"
+
+SharedBuffer::SharedBuffer() : _data(), _refs(1)
+{
+}
+
+SharedBuffer::~SharedBuffer()
+{
+}
+
+SharedBuffer *SharedBuffer::create(std::string &data)
+{
+	SharedBuffer *buffer = new SharedBuffer();
+	buffer->_data.swap(data);
+	return buffer;
+}
+
+void SharedBuffer::retain()
+{
+	++_refs;
+}
+
+void SharedBuffer::release()
+{
+	if (--_refs == 0)
+		delete this;
+}
+
+const char *SharedBuffer::data() const
+{
+	return _data.data();
+}
+
+size_t SharedBuffer::size() const
+{
+	return _data.size();
+}
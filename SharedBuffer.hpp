@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+/**
+ * Immutable bytes referenced by several owners, such as a cached response
+ * queued on many connections at once. The last release() frees it.
+ */
+class SharedBuffer
+{
+public:
+	// Takes the content of data, the caller holds the first reference
+	static SharedBuffer *create(std::string &data);
+
+	void retain();
+	void release();
+	const char *data() const;
+	size_t size() const;
+
+private:
+	std::string _data;
+	unsigned _refs;
+
+	SharedBuffer();
+	~SharedBuffer();
+	SharedBuffer(const SharedBuffer &src);
+	SharedBuffer &operator=(const SharedBuffer &src);
+};
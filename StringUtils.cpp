@@ -1,8 +1,13 @@
-#include <ctime>
 #include <sstream>
 #include <iostream>
 #include <cstdlib> // for atoi
+#include <cstring>	// for strchr
+#include <stdint.h>
 #include <arpa/inet.h>
+#include <regex.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "StringUtils.hpp"
 
 std::string trim(const std::string &s)
@@ -170,26 +175,52 @@ int convertSizeToBytes(const std::string &size)
 	return atoi(number_str.c_str()) * multiplier;
 }
 
-std::string getCurrentTime()
-{
-	char date[100];
-	time_t now = time(0);
-	struct tm tm = *gmtime(&now);
-
-	strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
-
-	return std::string(date);
-}
-
 bool validHttpRequestChar(char c)
 {
-	const std::string allowedSymbols = "!#$%&'*+-.^_`|~";
-	if ((c >= 'a' && c <= 'z') || allowedSymbols.find(c) != std::string::npos ||
-		(c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+	static const char allowedSymbols[] = "!#$%&'*+-.^_`|~";
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+		(c != '\0' && std::strchr(allowedSymbols, c) != NULL))
 		return true;
 	return false;
 }
 
+/**
+ * Returns the length of the leading run of data made of bytes in [lo, hi]
+ * other than stop1 and stop2, i.e. the offset of the first delimiter or
+ * invalid byte. With SSE2 16 bytes are classified per step.
+ */
+size_t scanHttpRun(const char *data, size_t len, unsigned char lo, unsigned char hi, char stop1, char stop2)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	if (len >= 16)
+	{
+		// Unsigned range check: x is in [lo, hi] when min(x - lo, hi - lo) == x - lo
+		const __m128i low = _mm_set1_epi8(static_cast<char>(lo));
+		const __m128i span = _mm_set1_epi8(static_cast<char>(hi - lo));
+		const __m128i s1 = _mm_set1_epi8(stop1);
+		const __m128i s2 = _mm_set1_epi8(stop2);
+		for (; i + 16 <= len; i += 16)
+		{
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+			__m128i shifted = _mm_sub_epi8(x, low);
+			__m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(shifted, span), shifted);
+			__m128i stops = _mm_or_si128(_mm_cmpeq_epi8(x, s1), _mm_cmpeq_epi8(x, s2));
+			int mask = _mm_movemask_epi8(_mm_andnot_si128(stops, inRange)) ^ 0xFFFF;
+			if (mask != 0)
+				return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for (; i < len; ++i)
+	{
+		unsigned char c = data[i];
+		if (c < lo || c > hi || c == static_cast<unsigned char>(stop1) || c == static_cast<unsigned char>(stop2))
+			break;
+	}
+	return i;
+}
+
 std::string trimFromEnd(const std::string &str)
 {
 	size_t end = str.length();
@@ -211,3 +242,25 @@ std::string numberToString(size_t value)
 	ss << value;
 	return ss.str();
 }
+
+// 32-bit FNV-1a, for the hash tables built from the configuration
+size_t hashBytes(const char *data, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 16777619u; // wraps modulo 2^32 like the reference FNV-1a
+	}
+	return hash;
+}
+
+// True if regcomp() accepts pattern as a POSIX extended regex
+bool isValidRegex(const std::string &pattern)
+{
+	regex_t regex;
+	if (regcomp(&regex, pattern.c_str(), REG_EXTENDED | REG_NOSUB) != 0)
+		return false;
+	regfree(&regex);
+	return true;
+}
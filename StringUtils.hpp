@@ -10,7 +10,9 @@ bool isNumber(const std::string &s);
 std::string getStraddr(struct addrinfo *p);
 void printAddrinfo(const char *host, const char *port, struct addrinfo *ai);
 int convertSizeToBytes(const std::string &size);
-std::string getCurrentTime();
 bool validHttpRequestChar(char c);
+size_t scanHttpRun(const char *data, size_t len, unsigned char lo, unsigned char hi, char stop1, char stop2);
 std::string trimFromEnd(const std::string &str);
 std::string numberToString(size_t value);
+size_t hashBytes(const char *data, size_t length);
+bool isValidRegex(const std::string &pattern);
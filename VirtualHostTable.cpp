@@ -0,0 +1,147 @@
+#include <cctype>
+#include "VirtualHostTable.hpp"
+#include "Consts.hpp"
+#include "StringUtils.hpp"
+
+VirtualHostTable::VirtualHostTable() : _slots(), _count(0), _key()
+{
+}
+
+VirtualHostTable::VirtualHostTable(const VirtualHostTable &other) : _slots(other._slots),
+																	_count(other._count),
+																	_key()
+{
+}
+
+VirtualHostTable &VirtualHostTable::operator=(const VirtualHostTable &other)
+{
+	if (this != &other)
+	{
+		_slots = other._slots;
+		_count = other._count;
+	}
+	return *this;
+}
+
+VirtualHostTable::~VirtualHostTable()
+{
+}
+
+// The servers map already holds the first server of each address as its default
+void VirtualHostTable::build(const std::map<ServerKey, Server *> &servers)
+{
+	clear();
+	size_t capacity = kVirtualHostTableMinSize;
+	while (capacity < servers.size() * 2)
+		capacity *= 2;
+	Slot empty = {0, std::string(), NULL};
+	_slots.assign(capacity, empty);
+	for (std::map<ServerKey, Server *>::const_iterator it = servers.begin(); it != servers.end(); ++it)
+	{
+		std::string key = it->first.host;
+		key += '\0';
+		key += it->first.port;
+		key += '\0';
+		for (size_t i = 0; i < it->first.server_name.size(); ++i)
+			key += static_cast<char>(std::tolower(static_cast<unsigned char>(it->first.server_name[i])));
+		insert(key, it->second);
+	}
+}
+
+void VirtualHostTable::clear()
+{
+	_slots.clear();
+	_count = 0;
+}
+
+size_t VirtualHostTable::size() const
+{
+	return _count;
+}
+
+// Names that only differ by case keep the first server, like duplicates in addServer()
+void VirtualHostTable::insert(const std::string &key, Server *server)
+{
+	size_t hash = hashBytes(key.data(), key.size());
+	size_t mask = _slots.size() - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		if (_slots[i].server == NULL)
+		{
+			_slots[i].hash = hash;
+			_slots[i].key = key;
+			_slots[i].server = server;
+			++_count;
+			return;
+		}
+		if (_slots[i].hash == hash && _slots[i].key == key)
+			return;
+	}
+}
+
+Server *VirtualHostTable::lookup(const std::string &key) const
+{
+	if (_slots.empty())
+		return NULL;
+	size_t hash = hashBytes(key.data(), key.size());
+	size_t mask = _slots.size() - 1;
+	for (size_t i = hash & mask; _slots[i].server != NULL; i = (i + 1) & mask)
+	{
+		if (_slots[i].hash == hash && _slots[i].key == key)
+			return _slots[i].server;
+	}
+	return NULL;
+}
+
+// Exact name, then "*." wildcards from the longest suffix, then the default server of the address
+Server *VirtualHostTable::findOnAddress(const std::string &port, const std::string &address,
+										const char *name, size_t nameLength)
+{
+	_key.assign(address);
+	_key += '\0';
+	_key += port;
+	_key += '\0';
+	size_t prefix = _key.size();
+	for (size_t i = 0; i < nameLength; ++i)
+		_key += static_cast<char>(std::tolower(static_cast<unsigned char>(name[i])));
+	Server *server = lookup(_key);
+	if (server != NULL)
+		return server;
+	// www.example.com becomes *.example.com, then *.com
+	size_t dot = _key.find('.', prefix);
+	while (dot != std::string::npos)
+	{
+		_key.replace(prefix, dot - prefix, 1, '*');
+		server = lookup(_key);
+		if (server != NULL)
+			return server;
+		dot = _key.find('.', prefix + 2);
+	}
+	_key.resize(prefix);
+	return lookup(_key);
+}
+
+Server *VirtualHostTable::find(const std::string &port, const std::string &address, const std::string &hostHeader)
+{
+	// The name is the Host without its port and trailing dot, IPv6 literals keep their brackets
+	size_t length = hostHeader.size();
+	if (!hostHeader.empty() && hostHeader[0] == '[')
+	{
+		size_t bracket = hostHeader.find(']');
+		if (bracket != std::string::npos)
+			length = bracket + 1;
+	}
+	else
+	{
+		size_t colon = hostHeader.find(':');
+		if (colon != std::string::npos)
+			length = colon;
+	}
+	if (length > 0 && hostHeader[length - 1] == '.')
+		--length;
+
+	Server *server = findOnAddress(port, address, hostHeader.data(), length);
+	if (server == NULL && address != kDefaultHost)
+		server = findOnAddress(port, kDefaultHost, hostHeader.data(), length);
+	return server;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include "ServerKey.hpp"
+
+class Server;
+
+/**
+ * The server blocks of every listen address in one open addressing hash
+ * table, keyed by address, port and lower case server name. Each address
+ * also has an entry with an empty name for its default server, and
+ * "*.example.com" names are matched by dropping the leading labels of the
+ * Host, longest suffix first. Built once after the configuration is parsed.
+ */
+class VirtualHostTable
+{
+public:
+	VirtualHostTable();
+	VirtualHostTable(const VirtualHostTable &other);
+	VirtualHostTable &operator=(const VirtualHostTable &other);
+	~VirtualHostTable();
+
+	void build(const std::map<ServerKey, Server *> &servers);
+	void clear();
+	size_t size() const;
+
+	// Server for a request received on address:port, hostHeader as sent by the client, NULL if none
+	Server *find(const std::string &port, const std::string &address, const std::string &hostHeader);
+
+private:
+	struct Slot
+	{
+		size_t hash;
+		std::string key; // address '\0' port '\0' name, empty when the slot is free
+		Server *server;
+	};
+
+	std::vector<Slot> _slots; // power of two, at most half full
+	size_t _count;
+	std::string _key;		  // lookup key, reused to avoid an allocation per request
+
+	void insert(const std::string &key, Server *server);
+	Server *lookup(const std::string &key) const;
+	Server *findOnAddress(const std::string &port, const std::string &address,
+						  const char *name, size_t nameLength);
+};
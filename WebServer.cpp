@@ -1,18 +1,25 @@
 // Essential system includes
-#include <sys/epoll.h>	// for epoll functions
+#include <sys/epoll.h>	// for the EPOLL* event masks
 #include <sys/socket.h> // for socket functions
+#include <sys/un.h>		// for sockaddr_un
 #include <netdb.h>		// for getaddrinfo
 #include <arpa/inet.h>	// for inet_ntop
+#include <netinet/tcp.h> // for TCP_NODELAY
 #include <unistd.h>		// for close
 #include <fcntl.h>		// for fcntl
 #include <errno.h>		// for errno
 #include <cstring>		// for strerror
 #include <cstdlib>		// for atoi
+#include <csignal>		// for kill
+#include <sys/prctl.h>	// for prctl
+#include <time.h>		// for clock_gettime
 
 // Standard C++ includes
 #include <string>	 // for string operations
 #include <map>		 // for map containers
 #include <set>		 // for set containers
+#include <vector>	 // for the fd table
+#include <algorithm> // for std::max
 #include <iostream>	 // for cout/cerr
 #include <fstream>	 // for file operations
 #include <stdexcept> // for exceptions
@@ -27,17 +34,50 @@
 #include "Globals.hpp"
 #include "FileUtils.hpp"
 #include "ProcUtils.hpp"
+#include "HeaderCache.hpp"
 
 WebServer::WebServer(const std::string &filename) : _fileName(filename),
-													_epfd(-1),
+													_events(NULL),
 													_listeners(),
 													_clientTimeout(kDefaultClientTimeout),
 													_clientTimeoutSet(false),
 													_clientHeaderBufferSize(kDefaultClientHeaderBufferSize),
 													_clientHeaderBufferSizeSet(false),
 													_clientMaxBodySize(kDefaultClientMaxBodySize),
-													_clientMaxBodySizeSet(false)
+													_clientMaxBodySizeSet(false),
+													_workerProcesses(kDefaultWorkerProcesses),
+													_workerProcessesSet(false),
+													_multiAccept(kDefaultMultiAccept),
+													_multiAcceptSet(false),
+													_connectionPool(kDefaultConnectionPool),
+													_connectionPoolSet(false),
+													_eventsPerWakeup(kDefaultEventsPerWakeup),
+													_eventsPerWakeupSet(false),
+													_edgeTriggered(false),
+													_eventModeSet(false),
+													_eventBackend(kDefaultEventBackend),
+													_eventBackendSet(false),
+													_openFileCacheMax(kDefaultOpenFileCache),
+													_openFileCacheMaxSet(false),
+													_openFileCacheValid(kDefaultOpenFileCacheValid),
+													_openFileCacheValidSet(false),
+													_openFileCacheErrors(false),
+													_openFileCacheErrorsSet(false),
+													_openFileCache(),
+													_responseCacheSize(0),
+													_responseCacheSizeSet(false),
+													_responseCacheMaxFileSize(kDefaultResponseCacheMaxFileSize),
+													_responseCacheMaxFileSizeSet(false),
+													_responseCache(),
+													_deflatePool(),
+													_fastCgiPool(),
+													_virtualHosts()
 {
+	for (int i = 0; i < T_KINDS_COUNT; ++i)
+	{
+		_timeouts[i] = kDefaultClientTimeout;
+		_timeoutsSet[i] = false;
+	}
 	if (filename.empty())
 	{
 		throw std::invalid_argument("Empty filename");
@@ -47,25 +87,59 @@ WebServer::WebServer(const std::string &filename) : _fileName(filename),
 		throw std::invalid_argument("Invalid file extension");
 	}
 	this->parseConfig();
+	_virtualHosts.build(_servers);
 }
 
 // TODO: verify the copy logic in Server, LocationTrie, LocationTrieNode
 WebServer::WebServer(const WebServer &other) : _fileName(other._fileName),
-											   _epfd(-1),
+											   _events(NULL),
 											   _listeners(other._listeners),
 											   _clientTimeout(other._clientTimeout),
 											   _clientTimeoutSet(other._clientTimeoutSet),
 											   _clientHeaderBufferSize(other._clientHeaderBufferSize),
 											   _clientHeaderBufferSizeSet(other._clientHeaderBufferSizeSet),
 											   _clientMaxBodySize(other._clientMaxBodySize),
-											   _clientMaxBodySizeSet(other._clientMaxBodySizeSet)
+											   _clientMaxBodySizeSet(other._clientMaxBodySizeSet),
+											   _workerProcesses(other._workerProcesses),
+											   _workerProcessesSet(other._workerProcessesSet),
+											   _multiAccept(other._multiAccept),
+											   _multiAcceptSet(other._multiAcceptSet),
+											   _connectionPool(other._connectionPool),
+											   _connectionPoolSet(other._connectionPoolSet),
+											   _eventsPerWakeup(other._eventsPerWakeup),
+											   _eventsPerWakeupSet(other._eventsPerWakeupSet),
+											   _edgeTriggered(other._edgeTriggered),
+											   _eventModeSet(other._eventModeSet),
+											   _eventBackend(other._eventBackend),
+											   _eventBackendSet(other._eventBackendSet),
+											   _openFileCacheMax(other._openFileCacheMax),
+											   _openFileCacheMaxSet(other._openFileCacheMaxSet),
+											   _openFileCacheValid(other._openFileCacheValid),
+											   _openFileCacheValidSet(other._openFileCacheValidSet),
+											   _openFileCacheErrors(other._openFileCacheErrors),
+											   _openFileCacheErrorsSet(other._openFileCacheErrorsSet),
+											   _openFileCache(other._openFileCache),
+											   _responseCacheSize(other._responseCacheSize),
+											   _responseCacheSizeSet(other._responseCacheSizeSet),
+											   _responseCacheMaxFileSize(other._responseCacheMaxFileSize),
+											   _responseCacheMaxFileSizeSet(other._responseCacheMaxFileSizeSet),
+											   _responseCache(other._responseCache),
+											   _deflatePool(other._deflatePool),
+											   _fastCgiPool(other._fastCgiPool),
+											   _virtualHosts()
 {
+	for (int i = 0; i < T_KINDS_COUNT; ++i)
+	{
+		_timeouts[i] = other._timeouts[i];
+		_timeoutsSet[i] = other._timeoutsSet[i];
+	}
 	// Deep copy each server and store in _servers map
 	for (std::map<ServerKey, Server *>::const_iterator it = other._servers.begin();
 		 it != other._servers.end(); ++it)
 	{
 		_servers[it->first] = new Server(*it->second);
 	}
+	_virtualHosts.build(_servers);
 }
 
 // TODO: fix the copy logic in Server, LocationTrie, LocationTrieNode
@@ -78,7 +152,7 @@ WebServer &WebServer::operator=(const WebServer &other)
 
 		// Copy basic members
 		_fileName = other._fileName;
-		_epfd = -1; // Don't copy _epfd, create new one when needed
+		_events = NULL; // Don't copy the event backend, create new one when needed
 		_listeners = other._listeners;
 		_clientTimeout = other._clientTimeout;
 		_clientTimeoutSet = other._clientTimeoutSet;
@@ -86,6 +160,37 @@ WebServer &WebServer::operator=(const WebServer &other)
 		_clientHeaderBufferSizeSet = other._clientHeaderBufferSizeSet;
 		_clientMaxBodySize = other._clientMaxBodySize;
 		_clientMaxBodySizeSet = other._clientMaxBodySizeSet;
+		_workerProcesses = other._workerProcesses;
+		_workerProcessesSet = other._workerProcessesSet;
+		_multiAccept = other._multiAccept;
+		_multiAcceptSet = other._multiAcceptSet;
+		_connectionPool = other._connectionPool;
+		_connectionPoolSet = other._connectionPoolSet;
+		_eventsPerWakeup = other._eventsPerWakeup;
+		_eventsPerWakeupSet = other._eventsPerWakeupSet;
+		_edgeTriggered = other._edgeTriggered;
+		_eventModeSet = other._eventModeSet;
+		_eventBackend = other._eventBackend;
+		_eventBackendSet = other._eventBackendSet;
+		_openFileCacheMax = other._openFileCacheMax;
+		_openFileCacheMaxSet = other._openFileCacheMaxSet;
+		_openFileCacheValid = other._openFileCacheValid;
+		_openFileCacheValidSet = other._openFileCacheValidSet;
+		_openFileCacheErrors = other._openFileCacheErrors;
+		_openFileCacheErrorsSet = other._openFileCacheErrorsSet;
+		_openFileCache = other._openFileCache;
+		_responseCacheSize = other._responseCacheSize;
+		_responseCacheSizeSet = other._responseCacheSizeSet;
+		_responseCacheMaxFileSize = other._responseCacheMaxFileSize;
+		_responseCacheMaxFileSizeSet = other._responseCacheMaxFileSizeSet;
+		_responseCache = other._responseCache;
+		_deflatePool = other._deflatePool;
+		_fastCgiPool = other._fastCgiPool;
+		for (int i = 0; i < T_KINDS_COUNT; ++i)
+		{
+			_timeouts[i] = other._timeouts[i];
+			_timeoutsSet[i] = other._timeoutsSet[i];
+		}
 
 		// Deep copy servers
 		for (std::map<ServerKey, Server *>::const_iterator it = other._servers.begin();
@@ -93,6 +198,7 @@ WebServer &WebServer::operator=(const WebServer &other)
 		{
 			_servers[it->first] = new Server(*it->second);
 		}
+		_virtualHosts.build(_servers);
 	}
 	return *this;
 }
@@ -117,34 +223,73 @@ void WebServer::cleanupServers()
 	}
 
 	_servers.clear();
+	_virtualHosts.clear();
 }
 
 void WebServer::cleanupConnections()
 {
-	for (std::map<int, Connection *>::iterator it = _connections.begin();
-		 it != _connections.end(); ++it)
+	for (size_t fd = 0; fd < _fdTable.size(); ++fd)
 	{
-		delete it->second;
-		if (close(it->first) == -1)
+		if (_fdTable[fd].type != FD_CLIENT)
+			continue;
+		delete _fdTable[fd].conn;
+		if (close(fd) == -1)
 		{
 			int err = errno;
-			std::cerr << "close (" << it->first << "): " << strerror(err) << std::endl;
+			std::cerr << "close (" << fd << "): " << strerror(err) << std::endl;
 		}
+		clearFdSlot(fd);
+	}
+	trimConnectionPool(0);
+}
+
+// Takes a connection from the pool, or allocates one when it is empty
+Connection *WebServer::acquireConnection(int fd, const std::string &port, const std::string &host,
+										 const std::string &remotePort, const std::string &remoteHost)
+{
+	if (_freeConnections.empty())
+		return new Connection(fd, port, host, remotePort, remoteHost, this);
+	Connection *conn = _freeConnections.back();
+	_freeConnections.pop_back();
+	conn->attach(fd, port, host, remotePort, remoteHost);
+	return conn;
+}
+
+void WebServer::releaseConnection(Connection *conn)
+{
+	if (_freeConnections.size() >= static_cast<size_t>(_connectionPool))
+	{
+		delete conn; // it will destroy CGI process if any and close the fds
+		return;
+	}
+	conn->detach();
+	_freeConnections.push_back(conn);
+}
+
+// Frees the idle connections beyond the first keep ones
+void WebServer::trimConnectionPool(size_t keep)
+{
+	while (_freeConnections.size() > keep)
+	{
+		delete _freeConnections.back();
+		_freeConnections.pop_back();
 	}
-	_connections.clear();
 }
 
 void WebServer::cleanupPipes()
 {
-	for (std::map<int, Connection *>::iterator it = _pipes.begin();
-		 it != _pipes.end(); ++it)
+	for (size_t fd = 0; fd < _fdTable.size(); ++fd)
 	{
+		if (_fdTable[fd].type != FD_CGI_PIPE)
+			continue;
 		// Control shot, just in case we missed any of them.
 		// We don't need to delete the Connection object here
 		// because it's deleted in the handleConnectionClose.
-		close(it->first);
+		close(fd);
+		clearFdSlot(fd);
 	}
-	_pipes.clear();
+	_fastCgiPool.clear(); // closes the FD_FASTCGI sockets
+	_fdTable.clear();
 }
 
 void WebServer::terminateCgiProcesses(bool graceful)
@@ -243,7 +388,7 @@ void WebServer::reapDeadChildren(int timeoutMs, int checkIntervalMs)
 
 WebServer::~WebServer()
 {
-	cleanupEpoll();
+	cleanupEvents();
 	cleanupConnections();
 	closeListenerSockets();
 	cleanupPipes();
@@ -284,6 +429,24 @@ bool WebServer::isClientTimeoutSet() const
 	return _clientTimeoutSet;
 }
 
+void WebServer::setTimeout(TimerKind kind, int timeout)
+{
+	_timeouts[kind] = timeout;
+	_timeoutsSet[kind] = true;
+}
+
+int WebServer::getTimeout(TimerKind kind) const
+{
+	if (!_timeoutsSet[kind])
+		return _clientTimeout;
+	return _timeouts[kind];
+}
+
+bool WebServer::isTimeoutSet(TimerKind kind) const
+{
+	return _timeoutsSet[kind];
+}
+
 void WebServer::setClientHeaderBufferSize(const std::string &size)
 {
 	_clientHeaderBufferSize = convertSizeToBytes(size);
@@ -316,6 +479,182 @@ bool WebServer::isClientMaxBodySizeSet() const
 	return _clientMaxBodySizeSet;
 }
 
+void WebServer::setWorkerProcesses(int workers)
+{
+	_workerProcesses = workers;
+	_workerProcessesSet = true;
+}
+
+int WebServer::getWorkerProcesses() const
+{
+	return _workerProcesses;
+}
+
+bool WebServer::isWorkerProcessesSet() const
+{
+	return _workerProcessesSet;
+}
+
+void WebServer::setMultiAccept(int count)
+{
+	_multiAccept = count;
+	_multiAcceptSet = true;
+}
+
+int WebServer::getMultiAccept() const
+{
+	return _multiAccept;
+}
+
+bool WebServer::isMultiAcceptSet() const
+{
+	return _multiAcceptSet;
+}
+
+void WebServer::setConnectionPool(int count)
+{
+	_connectionPool = count;
+	_connectionPoolSet = true;
+}
+
+int WebServer::getConnectionPool() const
+{
+	return _connectionPool;
+}
+
+bool WebServer::isConnectionPoolSet() const
+{
+	return _connectionPoolSet;
+}
+
+void WebServer::setEventsPerWakeup(int count)
+{
+	_eventsPerWakeup = count;
+	_eventsPerWakeupSet = true;
+}
+
+int WebServer::getEventsPerWakeup() const
+{
+	return _eventsPerWakeup;
+}
+
+bool WebServer::isEventsPerWakeupSet() const
+{
+	return _eventsPerWakeupSet;
+}
+
+void WebServer::setEdgeTriggered(bool edgeTriggered)
+{
+	_edgeTriggered = edgeTriggered;
+	_eventModeSet = true;
+}
+
+bool WebServer::isEdgeTriggered() const
+{
+	return _edgeTriggered;
+}
+
+bool WebServer::isEventModeSet() const
+{
+	return _eventModeSet;
+}
+
+void WebServer::setEventBackend(const std::string &backend)
+{
+	_eventBackend = backend;
+	_eventBackendSet = true;
+}
+
+const std::string &WebServer::getEventBackend() const
+{
+	return _eventBackend;
+}
+
+bool WebServer::isEventBackendSet() const
+{
+	return _eventBackendSet;
+}
+
+void WebServer::setOpenFileCache(int maxEntries)
+{
+	_openFileCacheMax = maxEntries;
+	_openFileCacheMaxSet = true;
+}
+
+bool WebServer::isOpenFileCacheSet() const
+{
+	return _openFileCacheMaxSet;
+}
+
+void WebServer::setOpenFileCacheValid(int seconds)
+{
+	_openFileCacheValid = seconds;
+	_openFileCacheValidSet = true;
+}
+
+bool WebServer::isOpenFileCacheValidSet() const
+{
+	return _openFileCacheValidSet;
+}
+
+void WebServer::setOpenFileCacheErrors(bool cacheErrors)
+{
+	_openFileCacheErrors = cacheErrors;
+	_openFileCacheErrorsSet = true;
+}
+
+bool WebServer::isOpenFileCacheErrorsSet() const
+{
+	return _openFileCacheErrorsSet;
+}
+
+OpenFileCache &WebServer::getOpenFileCache()
+{
+	return _openFileCache;
+}
+
+void WebServer::setResponseCache(const std::string &size)
+{
+	_responseCacheSize = (size == "off") ? 0 : convertSizeToBytes(size);
+	_responseCacheSizeSet = true;
+}
+
+bool WebServer::isResponseCacheSet() const
+{
+	return _responseCacheSizeSet;
+}
+
+void WebServer::setResponseCacheMaxFileSize(const std::string &size)
+{
+	_responseCacheMaxFileSize = convertSizeToBytes(size);
+	_responseCacheMaxFileSizeSet = true;
+}
+
+bool WebServer::isResponseCacheMaxFileSizeSet() const
+{
+	return _responseCacheMaxFileSizeSet;
+}
+
+ResponseCache &WebServer::getResponseCache()
+{
+	return _responseCache;
+}
+
+DeflatePool &WebServer::getDeflatePool()
+{
+	return _deflatePool;
+}
+
+FastCgiPool &WebServer::getFastCgiPool()
+{
+	return _fastCgiPool;
+}
+
+VirtualHostTable &WebServer::getVirtualHosts()
+{
+	return _virtualHosts;
+}
+
 const std::map<ServerKey, Server *> &WebServer::getServers() const
 {
 	return _servers;
@@ -365,16 +704,31 @@ void WebServer::handleOpenBracket(const std::string &content_block, Server *&cur
 	}
 	else if (words[0] == "location")
 	{
-		if (words.size() != 2)
+		if (words.size() != 2 && words.size() != 3)
 			throw std::invalid_argument("Invalid location block");
 		if (state != SERVER)
 			throw std::invalid_argument("Location not inside server block");
-		if (!isValidAbsolutePath(words[1]))
-			throw std::invalid_argument("Invalid path in location block: " + words[1]);
-		Location *tmpLocation = curr_server->getLocationForURI(words[1]);
-		if (tmpLocation != NULL && tmpLocation->getPath() == words[1])
-			throw std::invalid_argument("Duplicate location: " + words[1]);
-		curr_location = new Location(words[1]);
+		LocationModifier modifier = LOC_PREFIX;
+		if (words.size() == 3)
+		{
+			if (words[1] == "=")
+				modifier = LOC_EXACT;
+			else if (words[1] == "^~")
+				modifier = LOC_PREFIX_STOP;
+			else if (words[1] == "~")
+				modifier = LOC_REGEX;
+			else
+				throw std::invalid_argument("Invalid location modifier: " + words[1]);
+		}
+		const std::string &path = words.back();
+		if (modifier == LOC_REGEX && !isValidRegex(path))
+			throw std::invalid_argument("Invalid regex in location block: " + path);
+		if (modifier != LOC_REGEX && !isValidAbsolutePath(path))
+			throw std::invalid_argument("Invalid path in location block: " + path);
+		if (curr_server->hasLocation(modifier, path))
+			throw std::invalid_argument("Duplicate location: " + path);
+		curr_location = new Location(path);
+		curr_location->setModifier(modifier);
 		curr_server->addLocation(curr_location);
 		state = LOCATION;
 	}
@@ -627,6 +981,70 @@ void WebServer::validateUrl(const std::string &url) const
 	}
 }
 
+// expires off | epoch | max | [-]<number>[s|m|h|d]
+void WebServer::parseExpiresDirective(const std::vector<std::string> &words, ExpiresMode &mode, long &seconds)
+{
+	if (words.size() != 2)
+		throw std::invalid_argument("Invalid expires directive");
+	const std::string &value = words[1];
+	seconds = 0;
+	if (value == "off")
+	{
+		mode = EXPIRES_OFF;
+		return;
+	}
+	if (value == "epoch")
+	{
+		mode = EXPIRES_EPOCH;
+		return;
+	}
+	if (value == "max")
+	{
+		mode = EXPIRES_MAX;
+		return;
+	}
+	bool negative = (value[0] == '-');
+	std::string number = value.substr(negative ? 1 : 0);
+	long unit = 1;
+	if (!number.empty())
+	{
+		char suffix = number[number.length() - 1];
+		if (suffix == 's' || suffix == 'm' || suffix == 'h' || suffix == 'd')
+		{
+			unit = (suffix == 'm') ? 60 : (suffix == 'h') ? 3600 : (suffix == 'd') ? 86400 : 1;
+			number.erase(number.length() - 1);
+		}
+	}
+	if (number.empty() || !isNumber(number) || number.length() > 9)
+		throw std::invalid_argument("Invalid time in expires directive: " + value);
+	seconds = atol(number.c_str()) * unit;
+	if (seconds > kMaxExpires)
+		throw std::invalid_argument("Time too large in expires directive: " + value);
+	if (negative)
+		seconds = -seconds;
+	mode = EXPIRES_TIME;
+}
+
+// "unix:/absolute/path" or "host:port"
+void WebServer::validateFastcgiPass(const std::string &address) const
+{
+	if (address.compare(0, 5, "unix:") == 0)
+	{
+		std::string path = address.substr(5);
+		if (path.empty() || path[0] != '/')
+			throw std::invalid_argument("Invalid unix socket path in fastcgi_pass directive: " + address);
+		if (path.length() >= sizeof(((struct sockaddr_un *)0)->sun_path))
+			throw std::invalid_argument("Unix socket path too long in fastcgi_pass directive: " + address);
+		return;
+	}
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos || colon == 0)
+		throw std::invalid_argument("Invalid fastcgi_pass directive, expected host:port or unix:/path: " + address);
+	std::string port = address.substr(colon + 1);
+	if (!isNumber(port) || port.length() > 5 || atoi(port.c_str()) < 1 || atoi(port.c_str()) > 65535)
+		throw std::invalid_argument("Invalid port in fastcgi_pass directive: " + address);
+}
+
 void WebServer::validateReturnDirective(const std::vector<std::string> &words)
 {
 	if (words.size() != 3)
@@ -728,6 +1146,63 @@ void WebServer::handleServerDirective(const std::vector<std::string> &words, Ser
 		else
 			throw std::invalid_argument("Invalid autoindex directive value: " + words[1]);
 	}
+	else if (words[0] == "expires")
+	{
+		if (curr_server->isExpiresSet())
+			throw std::invalid_argument("Duplicate expires directive");
+		ExpiresMode mode;
+		long seconds;
+		parseExpiresDirective(words, mode, seconds);
+		curr_server->setExpires(mode, seconds);
+	}
+	else if (words[0] == "gzip_static")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid gzip_static directive");
+		if (curr_server->isGzipStaticSet())
+			throw std::invalid_argument("Duplicate gzip_static directive");
+		if (words[1] == "on")
+			curr_server->setGzipStatic(true);
+		else if (words[1] == "off")
+			curr_server->setGzipStatic(false);
+		else
+			throw std::invalid_argument("Invalid gzip_static directive value: " + words[1]);
+	}
+	else if (words[0] == "gzip")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid gzip directive");
+		if (curr_server->isGzipSet())
+			throw std::invalid_argument("Duplicate gzip directive");
+		if (words[1] == "on")
+			curr_server->setGzip(true);
+		else if (words[1] == "off")
+			curr_server->setGzip(false);
+		else
+			throw std::invalid_argument("Invalid gzip directive value: " + words[1]);
+	}
+	else if (words[0] == "gzip_min_length")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid gzip_min_length directive");
+		if (curr_server->isGzipMinLengthSet())
+			throw std::invalid_argument("Duplicate gzip_min_length directive");
+		validateSizeFormat(words[1]);
+		curr_server->setGzipMinLength(convertSizeToBytes(words[1]));
+	}
+	else if (words[0] == "gzip_types")
+	{
+		if (words.size() < 2)
+			throw std::invalid_argument("Invalid gzip_types directive: no types specified");
+		if (curr_server->isGzipTypesSet())
+			throw std::invalid_argument("Duplicate gzip_types directive");
+		for (size_t i = 1; i < words.size(); ++i)
+		{
+			if (words[i] != "*" && words[i].find('/') == std::string::npos)
+				throw std::invalid_argument("Invalid MIME type in gzip_types directive: " + words[i]);
+			curr_server->addGzipType(words[i]);
+		}
+	}
 	else if (words[0] == "cgi_bin")
 	{
 		handle_cgi_bin_directive(words, curr_server);
@@ -772,6 +1247,63 @@ void WebServer::handleLocationDirective(const std::vector<std::string> &words, L
 		else
 			throw std::invalid_argument("Invalid autoindex directive value: " + words[1]);
 	}
+	else if (words[0] == "expires")
+	{
+		if (curr_location->isExpiresSet())
+			throw std::invalid_argument("Duplicate expires directive");
+		ExpiresMode mode;
+		long seconds;
+		parseExpiresDirective(words, mode, seconds);
+		curr_location->setExpires(mode, seconds);
+	}
+	else if (words[0] == "gzip_static")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid gzip_static directive");
+		if (curr_location->isGzipStaticSet())
+			throw std::invalid_argument("Duplicate gzip_static directive");
+		if (words[1] == "on")
+			curr_location->setGzipStatic(true);
+		else if (words[1] == "off")
+			curr_location->setGzipStatic(false);
+		else
+			throw std::invalid_argument("Invalid gzip_static directive value: " + words[1]);
+	}
+	else if (words[0] == "gzip")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid gzip directive");
+		if (curr_location->isGzipSet())
+			throw std::invalid_argument("Duplicate gzip directive");
+		if (words[1] == "on")
+			curr_location->setGzip(true);
+		else if (words[1] == "off")
+			curr_location->setGzip(false);
+		else
+			throw std::invalid_argument("Invalid gzip directive value: " + words[1]);
+	}
+	else if (words[0] == "gzip_min_length")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid gzip_min_length directive");
+		if (curr_location->isGzipMinLengthSet())
+			throw std::invalid_argument("Duplicate gzip_min_length directive");
+		validateSizeFormat(words[1]);
+		curr_location->setGzipMinLength(convertSizeToBytes(words[1]));
+	}
+	else if (words[0] == "gzip_types")
+	{
+		if (words.size() < 2)
+			throw std::invalid_argument("Invalid gzip_types directive: no types specified");
+		if (curr_location->isGzipTypesSet())
+			throw std::invalid_argument("Duplicate gzip_types directive");
+		for (size_t i = 1; i < words.size(); ++i)
+		{
+			if (words[i] != "*" && words[i].find('/') == std::string::npos)
+				throw std::invalid_argument("Invalid MIME type in gzip_types directive: " + words[i]);
+			curr_location->addGzipType(words[i]);
+		}
+	}
 	else if (words[0] == "return")
 	{
 		validateReturnDirective(words);
@@ -787,6 +1319,15 @@ void WebServer::handleLocationDirective(const std::vector<std::string> &words, L
 			throw std::invalid_argument("Invalid path in upload_directory directive");
 		curr_location->setUploadDirectory(words[1]);
 	}
+	else if (words[0] == "fastcgi_pass")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid fastcgi_pass directive");
+		if (curr_location->isFastcgiPassSet())
+			throw std::invalid_argument("Duplicate fastcgi_pass directive");
+		validateFastcgiPass(words[1]);
+		curr_location->setFastcgiPass(words[1]);
+	}
 	else if (words[0] == "allowed_methods")
 	{
 		if (words.size() < 2)
@@ -806,6 +1347,22 @@ void WebServer::handleLocationDirective(const std::vector<std::string> &words, L
 	}
 }
 
+// Returns the timer a timeout directive configures, T_KINDS_COUNT if it is not one
+static TimerKind timeoutDirectiveKind(const std::string &directive)
+{
+	if (directive == "client_header_timeout")
+		return T_HEADER;
+	if (directive == "client_body_timeout")
+		return T_BODY;
+	if (directive == "send_timeout")
+		return T_SEND;
+	if (directive == "keepalive_timeout")
+		return T_KEEPALIVE;
+	if (directive == "cgi_timeout")
+		return T_CGI;
+	return T_KINDS_COUNT;
+}
+
 void WebServer::handleGlobalDirective(const std::vector<std::string> &words)
 {
 	if (words[0] == "client_timeout")
@@ -821,6 +1378,20 @@ void WebServer::handleGlobalDirective(const std::vector<std::string> &words)
 			throw std::invalid_argument("Invalid timeout in client_timeout directive");
 		setClientTimeout(timeout);
 	}
+	else if (timeoutDirectiveKind(words[0]) != T_KINDS_COUNT)
+	{
+		TimerKind kind = timeoutDirectiveKind(words[0]);
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid " + words[0] + " directive");
+		if (isTimeoutSet(kind))
+			throw std::invalid_argument("Duplicate " + words[0] + " directive");
+		if (!isNumber(words[1]))
+			throw std::invalid_argument(words[0] + " is not numeric");
+		int timeout = atoi(words[1].c_str());
+		if (timeout <= 0)
+			throw std::invalid_argument("Invalid timeout in " + words[0] + " directive");
+		setTimeout(kind, timeout);
+	}
 	else if (words[0] == "client_header_buffer_size")
 	{
 		if (words.size() != 2)
@@ -839,42 +1410,188 @@ void WebServer::handleGlobalDirective(const std::vector<std::string> &words)
 		validateSizeFormat(words[1]);
 		this->setClientMaxBodySize(words[1]);
 	}
-	else
+	else if (words[0] == "worker_processes")
 	{
-		throw std::invalid_argument("Invalid directive in global block: " + words[0]);
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid worker_processes directive");
+		if (isWorkerProcessesSet())
+			throw std::invalid_argument("Duplicate worker_processes directive");
+		int workers;
+		if (words[1] == "auto")
+		{
+			long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			workers = cpus > 0 ? static_cast<int>(cpus) : kDefaultWorkerProcesses;
+		}
+		else
+		{
+			if (!isNumber(words[1]))
+				throw std::invalid_argument("worker_processes is not numeric");
+			workers = atoi(words[1].c_str());
+		}
+		if (workers <= 0 || workers > kMaxWorkerProcesses)
+			throw std::invalid_argument("Invalid number in worker_processes directive");
+		setWorkerProcesses(workers);
 	}
-}
-
-void WebServer::handleDirective(const std::string &content_block, Server *curr_server, Location *curr_location, ParseState &state)
-{
-	std::vector<std::string> words = splitByWhiteSpaces(content_block);
-	if (words.size() == 0)
-		throw std::invalid_argument("unexpected \";\"");
-	switch (state)
+	else if (words[0] == "multi_accept")
 	{
-	case GLOBAL:
-		handleGlobalDirective(words);
-		break;
-	case SERVER:
-		handleServerDirective(words, curr_server);
-		break;
-	case LOCATION:
-		handleLocationDirective(words, curr_location);
-		break;
-	default:
-		throw std::invalid_argument("Invalid state");
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid multi_accept directive");
+		if (isMultiAcceptSet())
+			throw std::invalid_argument("Duplicate multi_accept directive");
+		if (!isNumber(words[1]))
+			throw std::invalid_argument("multi_accept is not numeric");
+		int count = atoi(words[1].c_str());
+		if (count <= 0 || count > kMaxMultiAccept)
+			throw std::invalid_argument("Invalid number in multi_accept directive");
+		setMultiAccept(count);
 	}
-}
-
-void WebServer::inheritServerDirectives(Server *curr_server)
-{
-	std::vector<Location *> locations = curr_server->getLocations();
-	for (size_t i = 0; i < locations.size(); ++i)
+	else if (words[0] == "connection_pool")
 	{
-		Location *loc = locations[i];
-
-		// Inherit root if not set in location
-		if (!loc->isRootSet() && curr_server->isRootSet())
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid connection_pool directive");
+		if (isConnectionPoolSet())
+			throw std::invalid_argument("Duplicate connection_pool directive");
+		if (!isNumber(words[1]))
+			throw std::invalid_argument("connection_pool is not numeric");
+		int count = atoi(words[1].c_str());
+		if (count < 0 || count > kMaxConnectionPool)
+			throw std::invalid_argument("Invalid number in connection_pool directive");
+		setConnectionPool(count);
+	}
+	else if (words[0] == "events_per_wakeup")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid events_per_wakeup directive");
+		if (isEventsPerWakeupSet())
+			throw std::invalid_argument("Duplicate events_per_wakeup directive");
+		if (!isNumber(words[1]))
+			throw std::invalid_argument("events_per_wakeup is not numeric");
+		int count = atoi(words[1].c_str());
+		if (count <= 0 || count > kMaxEventsPerWakeup)
+			throw std::invalid_argument("Invalid number in events_per_wakeup directive");
+		setEventsPerWakeup(count);
+	}
+	else if (words[0] == "event_mode")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid event_mode directive");
+		if (isEventModeSet())
+			throw std::invalid_argument("Duplicate event_mode directive");
+		if (words[1] == "edge")
+			setEdgeTriggered(true);
+		else if (words[1] == "level")
+			setEdgeTriggered(false);
+		else
+			throw std::invalid_argument("Invalid value in event_mode directive: " + words[1]);
+	}
+	else if (words[0] == "event_backend")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid event_backend directive");
+		if (isEventBackendSet())
+			throw std::invalid_argument("Duplicate event_backend directive");
+		if (words[1] != "epoll" && words[1] != "io_uring")
+			throw std::invalid_argument("Invalid value in event_backend directive: " + words[1]);
+		setEventBackend(words[1]);
+	}
+	else if (words[0] == "open_file_cache")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid open_file_cache directive");
+		if (isOpenFileCacheSet())
+			throw std::invalid_argument("Duplicate open_file_cache directive");
+		int count = 0;
+		if (words[1] != "off")
+		{
+			if (!isNumber(words[1]))
+				throw std::invalid_argument("open_file_cache is not numeric");
+			count = atoi(words[1].c_str());
+			if (count <= 0 || count > kMaxOpenFileCache)
+				throw std::invalid_argument("Invalid number in open_file_cache directive");
+		}
+		setOpenFileCache(count);
+	}
+	else if (words[0] == "open_file_cache_valid")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid open_file_cache_valid directive");
+		if (isOpenFileCacheValidSet())
+			throw std::invalid_argument("Duplicate open_file_cache_valid directive");
+		if (!isNumber(words[1]))
+			throw std::invalid_argument("open_file_cache_valid is not numeric");
+		int seconds = atoi(words[1].c_str());
+		if (seconds < 0 || seconds > kMaxOpenFileCacheValid)
+			throw std::invalid_argument("Invalid number in open_file_cache_valid directive");
+		setOpenFileCacheValid(seconds);
+	}
+	else if (words[0] == "open_file_cache_errors")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid open_file_cache_errors directive");
+		if (isOpenFileCacheErrorsSet())
+			throw std::invalid_argument("Duplicate open_file_cache_errors directive");
+		if (words[1] == "on")
+			setOpenFileCacheErrors(true);
+		else if (words[1] == "off")
+			setOpenFileCacheErrors(false);
+		else
+			throw std::invalid_argument("Invalid open_file_cache_errors directive value: " + words[1]);
+	}
+	else if (words[0] == "response_cache")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid response_cache directive");
+		if (isResponseCacheSet())
+			throw std::invalid_argument("Duplicate response_cache directive");
+		if (words[1] != "off")
+			validateSizeFormat(words[1]);
+		setResponseCache(words[1]);
+	}
+	else if (words[0] == "response_cache_max_file_size")
+	{
+		if (words.size() != 2)
+			throw std::invalid_argument("Invalid response_cache_max_file_size directive");
+		if (isResponseCacheMaxFileSizeSet())
+			throw std::invalid_argument("Duplicate response_cache_max_file_size directive");
+		validateSizeFormat(words[1]);
+		setResponseCacheMaxFileSize(words[1]);
+	}
+	else
+	{
+		throw std::invalid_argument("Invalid directive in global block: " + words[0]);
+	}
+}
+
+void WebServer::handleDirective(const std::string &content_block, Server *curr_server, Location *curr_location, ParseState &state)
+{
+	std::vector<std::string> words = splitByWhiteSpaces(content_block);
+	if (words.size() == 0)
+		throw std::invalid_argument("unexpected \";\"");
+	switch (state)
+	{
+	case GLOBAL:
+		handleGlobalDirective(words);
+		break;
+	case SERVER:
+		handleServerDirective(words, curr_server);
+		break;
+	case LOCATION:
+		handleLocationDirective(words, curr_location);
+		break;
+	default:
+		throw std::invalid_argument("Invalid state");
+	}
+}
+
+void WebServer::inheritServerDirectives(Server *curr_server)
+{
+	std::vector<Location *> locations = curr_server->getLocations();
+	for (size_t i = 0; i < locations.size(); ++i)
+	{
+		Location *loc = locations[i];
+
+		// Inherit root if not set in location
+		if (!loc->isRootSet() && curr_server->isRootSet())
 			loc->setRoot(curr_server->getRoot());
 
 		// Inherit index if not set in location
@@ -903,6 +1620,26 @@ void WebServer::inheritServerDirectives(Server *curr_server)
 		// Inherit autoindex if not set in location
 		if (!loc->isAutoindexSet() && curr_server->isAutoindexSet())
 			loc->setAutoindex(curr_server->getAutoindex());
+
+		// Inherit expires if not set in location
+		if (!loc->isExpiresSet() && curr_server->isExpiresSet())
+			loc->setExpires(curr_server->getExpiresMode(), curr_server->getExpiresSeconds());
+
+		// Inherit gzip_static if not set in location
+		if (!loc->isGzipStaticSet() && curr_server->isGzipStaticSet())
+			loc->setGzipStatic(curr_server->getGzipStatic());
+
+		// Inherit the gzip settings not set in location
+		if (!loc->isGzipSet() && curr_server->isGzipSet())
+			loc->setGzip(curr_server->getGzip());
+		if (!loc->isGzipMinLengthSet() && curr_server->isGzipMinLengthSet())
+			loc->setGzipMinLength(curr_server->getGzipMinLength());
+		if (!loc->isGzipTypesSet() && curr_server->isGzipTypesSet())
+		{
+			const std::set<std::string> &types = curr_server->getGzipTypes();
+			for (std::set<std::string>::const_iterator type = types.begin(); type != types.end(); ++type)
+				loc->addGzipType(*type);
+		}
 	}
 }
 
@@ -961,6 +1698,7 @@ void WebServer::handleCloseBracket(const std::string &content_block, Server *&cu
 		throw std::invalid_argument("Closing bracket without opening bracket");
 	case SERVER:
 		inheritServerDirectives(curr_server);
+		curr_server->compileLocations();
 		addServer(curr_server);
 		curr_server = NULL;
 		state = GLOBAL;
@@ -1068,6 +1806,7 @@ void WebServer::closeListenerSockets()
 			std::cerr << "close (listener " << it->first << "): "
 					  << strerror(err) << std::endl;
 		}
+		clearFdSlot(it->first);
 	}
 	_listeners.clear();
 }
@@ -1117,7 +1856,7 @@ void WebServer::setupListenerSockets()
 			continue;
 		}
 
-		int listener = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		int listener = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
 		if (listener < 0)
 		{
 			int err = errno;
@@ -1128,10 +1867,11 @@ void WebServer::setupListenerSockets()
 		}
 		// Avoid error of "address already in use" error message
 		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)); // don't care about return value, do the best effort
-		if (bind(listener, ai->ai_addr, ai->ai_addrlen) < 0)
+		// Every worker binds its own listener, the kernel balances the connections between them
+		if (_workerProcesses > 1 && setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1)
 		{
 			int err = errno;
-			strerr = "bind(" + key.host + ":" + key.port + "): " + strerror(err);
+			strerr = "setsockopt SO_REUSEPORT(" + key.host + ":" + key.port + "): " + strerror(err);
 			if (close(listener) == -1)
 			{
 				err = errno;
@@ -1141,22 +1881,22 @@ void WebServer::setupListenerSockets()
 			freeaddrinfo(ai);
 			throw std::runtime_error(strerr);
 		}
-
-		// Set the socket to be non-blocking
-		if (!setNonblocking(listener))
+		if (bind(listener, ai->ai_addr, ai->ai_addrlen) < 0)
 		{
+			int err = errno;
+			strerr = "bind(" + key.host + ":" + key.port + "): " + strerror(err);
 			if (close(listener) == -1)
 			{
-				int err = errno;
+				err = errno;
 				std::cerr << "close (" << listener << "): " << strerror(err) << std::endl;
 			}
 			closeListenerSockets();
 			freeaddrinfo(ai);
-			throw std::runtime_error("Failed to set listener socket to non-blocking mode");
+			throw std::runtime_error(strerr);
 		}
 
-		// Listen
-		if (listen(listener, 10) == -1)
+		// Listen, the kernel caps the backlog at net.core.somaxconn
+		if (listen(listener, SOMAXCONN) == -1)
 		{
 			int err = errno;
 			strerr = "listen(" + key.host + ":" + key.port + "): " + strerror(err);
@@ -1170,6 +1910,7 @@ void WebServer::setupListenerSockets()
 			throw std::runtime_error(strerr);
 		}
 		_listeners[listener] = std::make_pair(key.host, key.port);
+		setFdSlot(listener, FD_LISTENER, NULL);
 		bound_addresses.insert(std::make_pair(key.host, key.port));
 		freeaddrinfo(ai); // All done with this structure
 	}
@@ -1185,37 +1926,52 @@ void WebServer::setupListenerSockets()
 }
 
 void WebServer::handleNewConnection(int listener)
+{
+	// Drain the listen backlog, at most multi_accept connections per wakeup
+	// so that a connection storm doesn't starve the established clients
+	for (int i = 0; i < _multiAccept; ++i)
+	{
+		if (!acceptConnection(listener))
+			break;
+	}
+}
+
+// Returns false when there is nothing left to accept on the listener
+bool WebServer::acceptConnection(int listener)
 {
 	socklen_t addrlen;
 	struct sockaddr_storage remoteaddr; // Client address
 	int newfd;							// Newly accept()ed socket descriptor
 	char remoteIP[INET6_ADDRSTRLEN];
 
-	// If listener is ready to read, handle new connection
+	// The accepted socket is non-blocking and close-on-exec from the start
 	addrlen = sizeof remoteaddr;
-	newfd = accept(listener, (struct sockaddr *)&remoteaddr, &addrlen);
+	newfd = accept4(listener, (struct sockaddr *)&remoteaddr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
 	if (newfd == -1)
 	{
-		perror("accept");
-		return;
-	}
-	// Set the new socket to non-blocking mode
-	if (!setNonblocking(newfd))
-	{
-		if (close(newfd) == -1)
-		{
-			perror("close newfd");
-		}
-		return;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return false; // backlog drained
+		if (errno == ECONNABORTED || errno == EINTR)
+			return true; // this one is gone, try the next one
+		perror("accept4");
+		return false;
 	}
 
-	if (addEpollEvents(newfd, EPOLLIN) == false)
+	// Pipelined responses are written back to back, with Nagle the small tail of
+	// each one would wait for the client's delayed ACK. A header never goes out
+	// alone (MSG_MORE) so disabling it costs no extra packets
+	int nodelay = 1;
+	setsockopt(newfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int)); // best effort
+
+	// In edge mode the interest set is registered once for the lifetime of the connection
+	uint32_t events = _edgeTriggered ? (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) : EPOLLIN;
+	if (addEvents(newfd, events) == false)
 	{
 		if (close(newfd) == -1)
 		{
 			perror("close newfd");
 		}
-		return;
+		return true;
 	}
 
 	// Print info about the new connection
@@ -1229,138 +1985,207 @@ void WebServer::handleNewConnection(int listener)
 
 	try
 	{
-		// Add the new connection to the map of connections
-		_connections[newfd] = new Connection(newfd,
+		// Add the new connection to the fd table
+		Connection *conn = acquireConnection(newfd,
 											 _listeners[listener].second,
 											 _listeners[listener].first,
 											 remotePort,
-											 remoteHost,
-											 this);
+											 remoteHost);
+		setFdSlot(newfd, FD_CLIENT, conn);
+		armTimer(conn, T_HEADER);
 	}
 	catch (const std::bad_alloc &e)
 	{
 		std::cerr << "failed to allocate memory for new connection: " << e.what() << std::endl;
-		if (epoll_ctl(_epfd, EPOLL_CTL_DEL, newfd, NULL) == -1)
+		trimConnectionPool(0); // hand the idle connections back to the allocator
+		if (_events->remove(newfd) == false)
 		{
-			perror("epoll_ctl: del error fd");
+			perror("events: del error fd");
 		}
 		closeFd(newfd);
-		return;
+		return false;
 	}
+	return true;
 }
 
-void WebServer::handleClientRecv(int fd)
+// Returns true when a response is ready to be sent on the connection
+bool WebServer::handleClientRecv(int fd)
 {
 	char buf[kMaxBuff]; // Buffer for client data
 
-	int nbytes = recv(fd, buf, kMaxBuff - 1, 0);
-	if (nbytes < 0)
+	// In edge-triggered mode the socket is read until it would block,
+	// otherwise one recv() per EPOLLIN is enough
+	do
 	{
-		// Error receiving data
-		int sockErr = 0;
-		socklen_t sockErrLen = sizeof(sockErr);
-		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &sockErr, &sockErrLen) == -1)
-		{
-			perror("getsockopt");
-		}
-		else
+		int nbytes = recv(fd, buf, kMaxBuff - 1, 0);
+		if (nbytes < 0)
 		{
-			if (!sockErr) // Not really an error just try again later
+			// Error receiving data
+			int sockErr = 0;
+			socklen_t sockErrLen = sizeof(sockErr);
+			if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &sockErr, &sockErrLen) == -1)
 			{
-				// No data available
-				return;
+				perror("getsockopt");
 			}
 			else
 			{
-				perror("recv");
+				if (!sockErr) // Not really an error just try again later
+				{
+					// No data available
+					return false;
+				}
+				else
+				{
+					perror("recv");
+				}
 			}
+			handleConnectionClose(fd);
+			return false;
+		}
+		else if (nbytes == 0)
+		{
+			// Connection closed
+			std::cout << "socket " << fd << " hung up" << std::endl;
+			handleConnectionClose(fd);
+			return false;
+		}
+		else // We got some data from a client
+		{
+			Connection *conn = getFdConnection(fd);
+			conn->updateActivityTime();
+			RequestState state = conn->handleClientRecv(buf, nbytes);
+			if (state == S_CGI_PROCESSING || !conn->isResponseComplete())
+				return startResponse(fd, conn, state);
+			armRequestTimer(conn);
 		}
+	} while (_edgeTriggered);
+	return false;
+}
+
+/**
+ * Follows up on a complete request: either its CGI was just started or
+ * responses are queued. Returns true when there is something to send now.
+ */
+bool WebServer::startResponse(int fd, Connection *conn, RequestState state)
+{
+	if (state != S_CGI_PROCESSING)
+	{
+		armTimer(conn, T_SEND);
+		// Now we listen only on EPOLLOUT, in edge mode EPOLLOUT is always armed
+		if (!_edgeTriggered && updateEvents(fd, EPOLLOUT) == false)
+		{
+			handleConnectionClose(fd);
+			return false;
+		}
+		return true;
+	}
+	bool fastCgi = conn->getLocationConfig()->isFastcgiPassSet();
+	if (fastCgi && !startFastCgi(conn))
+	{
+		// The backend can't be reached, its 502 goes out like any response
+		return startResponse(fd, conn, S_ERROR);
+	}
+	armTimer(conn, T_CGI);
+	// Register for waiting for CGI process to finish
+	registerCgiProcess(conn->getCgiPid());
+
+	// We are in CGI processing, we need to add the CGI pipes to the epoll
+	// and remove the client socket from listening on EPOLLIN.
+	// In edge mode the client socket stays registered, its events
+	// are ignored until the CGI is done.
+	if (!_edgeTriggered && _events->remove(fd) == false)
+	{
+		perror("events: del error fd");
 		handleConnectionClose(fd);
-		return;
+		return false;
 	}
-	else if (nbytes == 0)
+	if (fastCgi)
+		return !conn->isResponseComplete();
+	int cgiFd = conn->getCgiInFd();
+	if (addEvents(cgiFd, EPOLLOUT) == false)
 	{
-		// Connection closed
-		std::cout << "socket " << fd << " hung up" << std::endl;
 		handleConnectionClose(fd);
-		return;
+		return false;
 	}
-	else // We got some data from a client
+	cgiFd = conn->getCgiOutFd();
+	if (addEvents(cgiFd, EPOLLIN) == false)
 	{
-		Connection *conn = _connections[fd];
-		buf[nbytes] = '\0';
-		conn->updateActivityTime();
-		// Create a std::string with explicit length to handle binary data with null bytes
-		RequestState state = conn->handleClientRecv(std::string(buf, nbytes));
-		// If the request is done, send the response at next EPOLLOUT event
-		if (state == S_DONE || state == S_ERROR)
-		{
-			// Now we listen only on EPOLLOUT
-			if (updateEpollEvents(fd, EPOLLOUT) == false)
-			{
-				handleConnectionClose(fd);
-				return;
-			}
-		}
-		else if (state == S_CGI_PROCESSING)
-		{
-			// Register for waiting for CGI process to finish
-			registerCgiProcess(conn->getCgiPid());
-
-			// We are in CGI processing, we need to add the CGI pipes to the epoll
-			// and remove the client socket from listening on EPOLLIN
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
-			{
-				perror("epoll_ctl: del error fd");
-				handleConnectionClose(fd);
-				return;
-			}
-			int cgiFd = conn->getCgiInFd();
-			if (addEpollEvents(cgiFd, EPOLLOUT) == false)
-			{
-				handleConnectionClose(fd);
-				return;
-			}
-			cgiFd = conn->getCgiOutFd();
-			if (addEpollEvents(cgiFd, EPOLLIN) == false)
-			{
-				handleConnectionClose(fd);
-				return;
-			}
-			_pipes[conn->getCgiInFd()] = conn;
-			_pipes[conn->getCgiOutFd()] = conn;
-		}
+		handleConnectionClose(fd);
+		return false;
 	}
+	setFdSlot(conn->getCgiInFd(), FD_CGI_PIPE, conn);
+	setFdSlot(conn->getCgiOutFd(), FD_CGI_PIPE, conn);
+	// In edge mode the responses to the requests pipelined before the CGI one
+	// go out while it runs, in level mode they wait for the CGI response
+	return !conn->isResponseComplete();
+}
+
+// Arms the timer matching the part of the request we are waiting for
+void WebServer::armRequestTimer(Connection *conn)
+{
+	RequestState state = conn->getRequestState();
+	if (state == S_START)
+		armTimer(conn, T_KEEPALIVE);
+	else if (state >= S_HEX && state <= S_BODY)
+		armTimer(conn, T_BODY);
+	else
+		armTimer(conn, T_HEADER);
 }
 
-void WebServer::handleClientSend(int fd)
+// Returns true when the response was sent and the connection is ready for the next request
+bool WebServer::handleClientSend(int fd)
 {
-	// Send the response to the client
-	Connection *conn = _connections[fd];
-	std::string response = conn->getResponse();
-	int nbytes = send(fd, response.c_str(), response.length(), 0);
-	if (nbytes >= 0)
+	// Send the next part of the response queue to the client
+	Connection *conn = getFdConnection(fd);
+	ssize_t nbytes = 0;
+	size_t sent = 0;
+	// In edge-triggered mode keep sending until the socket buffer is full
+	do
+	{
+		if (conn->isResponseComplete())
+			break;
+		nbytes = conn->sendResponse(fd);
+		if (nbytes == 0)
+		{
+			// A file was truncated while we were sending it, Content-Length is now a lie
+			std::cerr << "sendfile: file truncated, closing socket " << fd << std::endl;
+			handleConnectionClose(fd);
+			return false;
+		}
+		if (nbytes > 0)
+			sent += nbytes;
+	} while (_edgeTriggered && nbytes > 0);
+	// In edge mode the loop ends on a full socket buffer, the bytes sent before it still count as progress
+	if (nbytes >= 0 || sent > 0)
 	{
 		conn->updateActivityTime();
-		conn->eraseResponse(nbytes);
-		if (conn->getResponse().empty())
-		{
-			// Response sent, remove EPOLLOUT
-			if (updateEpollEvents(fd, EPOLLIN) == false)
+		if (!conn->isCgiRunning())
+			armTimer(conn, T_SEND);
+		if (conn->isResponseComplete())
+		{
+			// Edge mode: the CGI response comes next, the keep-alive flag already belongs to its request
+			if (conn->isCgiRunning())
+				return false;
+			if (!conn->isKeepAlive())
 			{
 				handleConnectionClose(fd);
-				return;
+				return false;
 			}
-
-			if (conn->isKeepAlive())
+			if (!conn->isReadingRequest())
 			{
-				// Reset the connection for the next request
-				conn->reset();
+				// The CGI response went out, go on with the requests pipelined behind it
+				RequestState state = conn->resumePipeline();
+				if (state == S_CGI_PROCESSING || !conn->isResponseComplete())
+					return startResponse(fd, conn, state);
 			}
-			else
+			// Response sent, remove EPOLLOUT
+			if (!_edgeTriggered && updateEvents(fd, EPOLLIN) == false)
 			{
 				handleConnectionClose(fd);
+				return false;
 			}
+			armRequestTimer(conn);
+			return true;
 		}
 	}
 	else
@@ -1377,7 +2202,7 @@ void WebServer::handleClientSend(int fd)
 			if (!sockErr)
 			{
 				// Socket buffer is full, keep EPOLLOUT
-				return;
+				return false;
 			}
 			else
 			{
@@ -1386,200 +2211,305 @@ void WebServer::handleClientSend(int fd)
 		}
 		handleConnectionClose(fd);
 	}
+	return false;
+}
+
+/**
+ * Drives a client connection in edge-triggered mode. An edge is reported
+ * only once, so the connection is advanced until the socket would block:
+ * read the request, send the response, then read the next request that
+ * may already be waiting in the socket buffer.
+ */
+void WebServer::handleClientEdge(int fd)
+{
+	Connection *conn = getFdConnection(fd);
+	while (getFdType(fd) == FD_CLIENT && getFdConnection(fd) == conn)
+	{
+		if (!conn->isResponseComplete())
+		{
+			if (!handleClientSend(fd))
+				break;
+		}
+		else if (conn->isReadingRequest())
+		{
+			if (!handleClientRecv(fd))
+				break;
+		}
+		else
+		{
+			break; // waiting for the CGI process
+		}
+	}
+}
+
+// Hands the request to a backend socket of the pool, false if none can be reached
+bool WebServer::startFastCgi(Connection *conn)
+{
+	std::vector<std::string> params;
+	conn->buildFastCgiParams(params);
+	uint16_t requestId = 0;
+	int fd = _fastCgiPool.submit(conn->getLocationConfig()->getFastcgiPass(), conn, params,
+								 conn->getFastCgiStdin(), requestId);
+	if (fd == -1)
+	{
+		conn->failFastCgi();
+		return false;
+	}
+	conn->setFastCgiRequest(fd, requestId);
+	if (getFdType(fd) != FD_FASTCGI)
+	{
+		// A new socket, the loop watches it until the backend or the worker closes it
+		uint32_t events = 0;
+		_fastCgiPool.updateEvents(fd, events);
+		if (addEvents(fd, events) == false)
+		{
+			_fastCgiPool.close(fd); // fails the request with a 502
+			_fastCgiPool.getFinished().clear();
+			return false;
+		}
+		setFdSlot(fd, FD_FASTCGI, NULL);
+	}
+	else
+		syncFastCgiEvents(fd);
+	return true;
+}
+
+// Watches for EPOLLOUT only while records wait to be sent
+void WebServer::syncFastCgiEvents(int fd)
+{
+	uint32_t events = 0;
+	if (_fastCgiPool.updateEvents(fd, events))
+		updateEvents(fd, events);
+}
+
+void WebServer::handleFastCgiEvent(int fd, uint32_t events)
+{
+	if (_fastCgiPool.handleEvent(fd, events))
+		syncFastCgiEvents(fd);
+	else
+	{
+		if (_events->remove(fd) == false)
+		{
+			if (DEBUG)
+			{
+				perror("events: del error fd");
+			}
+		}
+		clearFdSlot(fd);
+		_fastCgiPool.close(fd); // the requests still running on it end with a 502
+	}
+	// Resuming a client may send its next request to the pool, which can finish more of them
+	std::vector<Connection *> finished;
+	while (!_fastCgiPool.getFinished().empty())
+	{
+		finished.swap(_fastCgiPool.getFinished());
+		for (size_t i = 0; i < finished.size(); ++i)
+			resumeClientAfterCgi(finished[i]);
+		finished.clear();
+	}
+}
+
+// The CGI is done and its response is queued, hand the client socket back to the loop
+void WebServer::resumeClientAfterCgi(Connection *conn)
+{
+	armTimer(conn, T_SEND);
+	int fd = conn->getFd();
+	if (_edgeTriggered)
+	{
+		// The client socket never left epoll, try to send right away
+		handleClientEdge(fd);
+		return;
+	}
+	// Now we listen only on client socket EPOLLOUT
+	if (addEvents(fd, EPOLLOUT) == false)
+	{
+		handleConnectionClose(fd);
+	}
 }
 
 void WebServer::handleCgiRecv(int fd)
 {
 	// Handle CGI process output
-	Connection *conn = _pipes[fd];
+	Connection *conn = getFdConnection(fd);
 	RequestState state = conn->handleCgiRecv(fd);//TODO: explain me
-	if (state == S_DONE || state == S_ERROR)
+	if (state == S_CGI_PROCESSING)
+	{
+		armTimer(conn, T_CGI);
+	}
+	else if (state == S_DONE || state == S_ERROR)
 	{
 		// CGI process finished, remove the pipes from epoll
 		fd = conn->getCgiInFd();
-		_pipes.erase(fd);
+		clearFdSlot(fd);
 		if (fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+			if (_events->remove(fd) == false)
 			{
-				perror("epoll_ctl: del error fd");
+				perror("events: del error fd");
 			}
 			closeFd(fd);
 			conn->setCgiInFd(-1);
 		}
 		fd = conn->getCgiOutFd();
-		_pipes.erase(fd);
+		clearFdSlot(fd);
 		if (fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+			if (_events->remove(fd) == false)
 			{
-				perror("epoll_ctl: del error fd");
+				perror("events: del error fd");
 			}
 			closeFd(fd);
 			conn->setCgiOutFd(-1);
 		}
-		// Now we listen only on client socket EPOLLOUT
-		fd = conn->getFd();
-		if (addEpollEvents(fd, EPOLLOUT) == false)
-		{
-			handleConnectionClose(fd);
-			return;
-		}
+		resumeClientAfterCgi(conn);
 	}
 }
 
 void WebServer::finalizeCgiRecv(int fd)
 {
-	Connection *conn = _pipes[fd];
+	Connection *conn = getFdConnection(fd);
 	RequestState state = conn->finalizeCgiRecv(fd);
 	if (state == S_DONE || state == S_ERROR)
 	{
 		// CGI process finished, remove the pipes from epoll
 		fd = conn->getCgiInFd();
-		_pipes.erase(fd);
+		clearFdSlot(fd);
 		if (fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+			if (_events->remove(fd) == false)
 			{
 				if (DEBUG)
 				{
-					perror("epoll_ctl: del error fd");
+					perror("events: del error fd");
 				}
 			}
 			closeFd(fd);
 			conn->setCgiInFd(-1);
 		}
 		fd = conn->getCgiOutFd();
-		_pipes.erase(fd);
+		clearFdSlot(fd);
 		if (fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+			if (_events->remove(fd) == false)
 			{
 				if (DEBUG)
 				{
-					perror("epoll_ctl: del error fd");
+					perror("events: del error fd");
 				}
 			}
 			closeFd(fd);
 			conn->setCgiOutFd(-1);
 		}
-		// Now we listen only on client socket EPOLLOUT
-		fd = conn->getFd();
-		if (addEpollEvents(fd, EPOLLOUT) == false)
-		{
-			handleConnectionClose(fd);
-			return;
-		}
+		resumeClientAfterCgi(conn);
 	}
 }
 
 void WebServer::handleCgiSend(int fd)
 {
-	Connection *conn = _pipes[fd];
+	Connection *conn = getFdConnection(fd);
 	RequestState state = conn->handleCgiSend(fd);
-	if (state == S_DONE)
+	if (state == S_CGI_PROCESSING)
+	{
+		armTimer(conn, T_CGI);
+	}
+	else if (state == S_DONE)
 	{
+		armTimer(conn, T_CGI);
 		// Body completely sent to CGI
-		if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+		if (_events->remove(fd) == false)
 		{
 			if (DEBUG)
 			{
-				perror("epoll_ctl: del error fd");
+				perror("events: del error fd");
 			}
 		}
 		closeFd(fd);
 		conn->setCgiInFd(-1);
-		_pipes.erase(fd);
+		clearFdSlot(fd);
 	}
 	else if (state == S_ERROR)
 	{
 		// Error sending data to CGI, remove the pipes from epoll
 		fd = conn->getCgiInFd();
-		_pipes.erase(fd);
+		clearFdSlot(fd);
 		if (fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+			if (_events->remove(fd) == false)
 			{
 				if (DEBUG)
 				{
-					perror("epoll_ctl: del error fd");
+					perror("events: del error fd");
 				}
 			}
 			closeFd(fd);
 			conn->setCgiInFd(-1);
 		}
 		fd = conn->getCgiOutFd();
-		_pipes.erase(fd);
+		clearFdSlot(fd);
 		if (fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+			if (_events->remove(fd) == false)
 			{
 				if (DEBUG)
 				{
-					perror("epoll_ctl: del error fd");
+					perror("events: del error fd");
 				}
 			}
 			closeFd(fd);
 			conn->setCgiOutFd(-1);
 		}
-		// Now we listen only on client socket EPOLLOUT
-		fd = conn->getFd();
-		if (addEpollEvents(fd, EPOLLOUT) == false)
-		{
-			handleConnectionClose(fd);
-			return;
-		}
+		resumeClientAfterCgi(conn);
 	}
 }
 
 void WebServer::handleConnectionClose(int fd)
 {
-	if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+	if (_events->remove(fd) == false)
 	{
 		if (DEBUG)
 		{
-			perror("epoll_ctl: del error fd");
+			perror("events: del error fd");
 		}
 	}
-	// Check if the fd is in the connections map or in the listeners map
-	std::map<int, Connection *>::iterator it = _connections.find(fd);
-	if (it != _connections.end())
+	// Check if the fd is a client connection or a listener
+	FdType type = getFdType(fd);
+	if (type == FD_CLIENT)
 	{
-		Connection *conn = it->second;
+		Connection *conn = getFdConnection(fd);
 		int cgi_fd = conn->getCgiInFd();
 		if (cgi_fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, cgi_fd, NULL) == -1)
+			if (_events->remove(cgi_fd) == false)
 			{
 				if (DEBUG)
 				{
-					perror("epoll_ctl: del error fd");
+					perror("events: del error fd");
 				}
 			}
 		}
-		_pipes.erase(cgi_fd);
+		clearFdSlot(cgi_fd);
 
 		cgi_fd = conn->getCgiOutFd();
 		if (cgi_fd != -1)
 		{
-			if (epoll_ctl(_epfd, EPOLL_CTL_DEL, cgi_fd, NULL) == -1)
+			if (_events->remove(cgi_fd) == false)
 			{
 				if (DEBUG)
 				{
-					perror("epoll_ctl: del error fd");
+					perror("events: del error fd");
 				}
 			}
 		}
-		_pipes.erase(cgi_fd);
+		clearFdSlot(cgi_fd);
 
-		delete conn; // it will destroy CGI process if any and close the fds
-		_connections.erase(it);
+		disarmTimer(conn);
+		releaseConnection(conn); // stops the CGI process if any and closes its fds
 	}
-	std::map<int, std::pair<std::string, std::string> >::iterator it2 = _listeners.find(fd);
-	if (it2 != _listeners.end())
+	else if (type == FD_LISTENER)
 	{
-		_listeners.erase(it2);
+		_listeners.erase(fd);
 	}
+	clearFdSlot(fd);
 	// Close the socket
 	if (close(fd) == -1)
 	{
@@ -1591,78 +2521,88 @@ void WebServer::processPollEvents(int ready)
 {
 	for (int i = 0; i < ready; i++)
 	{
-		if (_evlist[i].events & EPOLLIN)
+		int fd = _evlist[i].data.fd;
+		FdType type = getFdType(fd);
+		if (type == FD_NONE)
+		{
+			// Stale event of a descriptor closed earlier in this batch or by a timeout.
+			// The number may already be reused by a cached file or a response segment, leave it alone
+			if (DEBUG)
+				std::cerr << "epoll: event on untracked fd " << fd << ", ignored" << std::endl;
+			continue;
+		}
+		if (type == FD_CLIENT && _edgeTriggered)
 		{
-			if (_listeners.find(_evlist[i].data.fd) != _listeners.end())
+			if (_evlist[i].events & (EPOLLERR | EPOLLHUP))
+			{
+				// An error or a full hangup, nothing more can be exchanged
+				std::cout << "epoll: hangup on fd " << fd << std::endl;
+				handleConnectionClose(fd);
+			}
+			else
+			{
+				handleClientEdge(fd);
+			}
+		}
+		else if (type == FD_FASTCGI)
+		{
+			// Shared by several clients, the pool sorts the records out
+			handleFastCgiEvent(fd, _evlist[i].events);
+		}
+		else if (_evlist[i].events & EPOLLIN)
+		{
+			if (type == FD_LISTENER)
 			{
 				// If listener is ready to read, handle new connection
-				handleNewConnection(_evlist[i].data.fd);
+				handleNewConnection(fd);
 			}
-			else if (_connections.find(_evlist[i].data.fd) != _connections.end())
+			else if (type == FD_CLIENT)
 			{
 				// If connection is ready to read, handle client data
-				handleClientRecv(_evlist[i].data.fd);
+				handleClientRecv(fd);
 			}
-			else if (_pipes.find(_evlist[i].data.fd) != _pipes.end())
+			else if (type == FD_CGI_PIPE)
 			{
 				// If pipe is ready to read, handle CGI process
-				handleCgiRecv(_evlist[i].data.fd);
-			}
-			else
-			{
-				// Unknown fd
-				std::cerr << "epoll: unknown fd " << _evlist[i].data.fd << std::endl;
-				handleConnectionClose(_evlist[i].data.fd);
+				handleCgiRecv(fd);
 			}
 		}
 		else if (_evlist[i].events & EPOLLOUT)
 		{
-			if (_connections.find(_evlist[i].data.fd) != _connections.end())
+			if (type == FD_CLIENT)
 			{
 				// If connection is ready to write, handle client send
-				handleClientSend(_evlist[i].data.fd);
+				handleClientSend(fd);
 			}
-			else if (_pipes.find(_evlist[i].data.fd) != _pipes.end())
+			else if (type == FD_CGI_PIPE)
 			{
 				// If pipe is ready to write, handle CGI process
-				handleCgiSend(_evlist[i].data.fd);
-			}
-			else
-			{
-				// Unknown fd
-				std::cerr << "epoll: unknown fd " << _evlist[i].data.fd << std::endl;
-				handleConnectionClose(_evlist[i].data.fd);
+				handleCgiSend(fd);
 			}
 		}
 		else if (_evlist[i].events & EPOLLHUP)
 		{
-			if (_connections.find(_evlist[i].data.fd) != _connections.end())
+			if (type == FD_CLIENT)
 			{
 				// If connection is hung up, handle client close
-				std::cout << "epoll: hangup on fd " << _evlist[i].data.fd << std::endl;
-				handleConnectionClose(_evlist[i].data.fd);
+				std::cout << "epoll: hangup on fd " << fd << std::endl;
+				handleConnectionClose(fd);
 			}
-			else if (_pipes.find(_evlist[i].data.fd) != _pipes.end())
+			else if (type == FD_CGI_PIPE)
 			{
 				// If pipe is hung up, handle CGI process close
-				finalizeCgiRecv(_evlist[i].data.fd);
+				finalizeCgiRecv(fd);
 			}
-			else if (_listeners.find(_evlist[i].data.fd) != _listeners.end())
+			else if (type == FD_LISTENER)
 			{
 				// If listener is hung up, we don't care
 			}
-			else
-			{
-				// Unknown fd
-				std::cerr << "epoll: unknown fd " << _evlist[i].data.fd << std::endl;
-				handleConnectionClose(_evlist[i].data.fd);
-			}
 		}
 		else if (_evlist[i].events & EPOLLERR)
 		{
 			// An error has occured on this fd
-			std::cerr << "epoll: error on fd " << _evlist[i].data.fd << std::endl;
-			handleConnectionClose(_evlist[i].data.fd);
+			std::cerr << "epoll: error on fd " << fd << std::endl;
+			handleConnectionClose(fd);
 		}
 		else
 		{
@@ -1671,99 +2611,52 @@ void WebServer::processPollEvents(int ready)
 	}
 }
 
-bool WebServer::updateEpollEvents(int fd, uint32_t events)
+bool WebServer::updateEvents(int fd, uint32_t events)
 {
-	struct epoll_event ev;
-	ev.events = events;
-	ev.data.fd = fd;
-	if (epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &ev) == -1)
+	if (_events->modify(fd, events) == false)
 	{
-		perror("epoll_ctl: mod error fd");
+		perror("events: mod error fd");
 		return false;
 	}
 	return true;
 }
 
-bool WebServer::addEpollEvents(int fd, uint32_t events)
+bool WebServer::addEvents(int fd, uint32_t events)
 {
-	struct epoll_event ev;
-	ev.events = events;
-	ev.data.fd = fd;
-	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+	if (_events->add(fd, events) == false)
 	{
-		perror("epoll_ctl: add error fd");
+		perror("events: add error fd");
 		return false;
 	}
 	return true;
 }
 
-void WebServer::initEpoll()
+void WebServer::initEvents()
 {
-	this->_epfd = epoll_create(42);
-	if (this->_epfd == -1)
-	{
-		perror("epoll_create");
-		throw std::runtime_error("epoll_create");
-	}
+	_events = EventBackend::create(_eventBackend);
+	if (DEBUG)
+		std::cout << "event backend: " << _events->getName() << std::endl;
 
 	for (std::map<int, std::pair<std::string, std::string> >::iterator it = _listeners.begin();
 		 it != _listeners.end(); ++it)
 	{
-		struct epoll_event ev;
-		ev.events = EPOLLIN;
-		ev.data.fd = it->first;
-		if (epoll_ctl(this->_epfd, EPOLL_CTL_ADD, it->first, &ev) == -1)
+		if (_events->add(it->first, EPOLLIN) == false)
 		{
 			int err = errno;
-			perror("epoll_ctl: listener_sock");
-			if (close(this->_epfd) == -1)
-			{
-				perror("close _epfd");
-			}
-			_epfd = -1;
+			perror("events: listener_sock");
+			cleanupEvents();
 			std::stringstream ss;
-			ss << "epoll_ctl: failed to add listener socket " << it->first << ": " << strerror(err);
+			ss << "failed to add listener socket " << it->first << " to " << _eventBackend << ": " << strerror(err);
 			throw std::runtime_error(ss.str());
 		}
 	}
 }
 
-void WebServer::cleanupEpoll()
+void WebServer::cleanupEvents()
 {
-	if (_epfd == -1)
-		return;
-	for (std::map<int, std::pair<std::string, std::string> >::iterator it = _listeners.begin();
-		 it != _listeners.end(); ++it)
-	{
-		// Remove the listener from epoll
-		epoll_ctl(_epfd, EPOLL_CTL_DEL, it->first, NULL);
-	}
-	for (std::map<int, Connection *>::iterator it = _connections.begin();
-		 it != _connections.end(); ++it)
-	{
-		// Remove the CGI pipes from epoll
-		int cgi_fd = it->second->getCgiInFd();
-		if (cgi_fd != -1)
-			epoll_ctl(_epfd, EPOLL_CTL_DEL, cgi_fd, NULL);
-		cgi_fd = it->second->getCgiOutFd();
-		if (cgi_fd != -1)
-			epoll_ctl(_epfd, EPOLL_CTL_DEL, cgi_fd, NULL);
-		// Remove the connection from epoll
-		epoll_ctl(_epfd, EPOLL_CTL_DEL, it->first, NULL);
-	}
-	for (std::map<int, Connection *>::iterator it = _pipes.begin();
-		 it != _pipes.end(); ++it)
-	{
-		// Remove the pipe from epoll (just in case we missed any of them)
-		epoll_ctl(_epfd, EPOLL_CTL_DEL, it->first, NULL);
-	}
-
-	if (close(_epfd) == -1)
-	{
-		int err = errno;
-		std::cerr << "close (" << _epfd << "): " << strerror(err) << std::endl;
-	}
-	_epfd = -1;
+	// Closing the epoll or io_uring instance drops every registration
+	delete _events;
+	_events = NULL;
 }
 
 void WebServer::printSettings() const
@@ -1856,7 +2749,8 @@ void WebServer::printSettings() const
 		for (size_t i = 0; i < locations.size(); ++i)
 		{
 			Location *loc = locations[i];
-			std::cout << "    Location " << loc->getPath() << ":\n";
+			const char *modifiers[] = {"", "^~ ", "= ", "~ "}; // indexed by LocationModifier
+			std::cout << "    Location " << modifiers[loc->getModifier()] << loc->getPath() << ":\n";
 
 			if (loc->isRootSet())
 				std::cout << "      Root: " << loc->getRoot() << "\n";
@@ -1901,6 +2795,73 @@ void WebServer::printSettings() const
 	std::cout << "\n===========================\n";
 }
 
+void WebServer::setFdSlot(int fd, FdType type, Connection *conn)
+{
+	if (fd < 0)
+		return;
+	if (static_cast<size_t>(fd) >= _fdTable.size())
+	{
+		// File descriptors are dense, grow geometrically to the highest one seen
+		FdSlot empty = {FD_NONE, NULL};
+		_fdTable.resize(std::max(static_cast<size_t>(fd) + 1, _fdTable.size() * 2), empty);
+	}
+	_fdTable[fd].type = type;
+	_fdTable[fd].conn = conn;
+}
+
+void WebServer::clearFdSlot(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _fdTable.size())
+		return;
+	_fdTable[fd].type = FD_NONE;
+	_fdTable[fd].conn = NULL;
+}
+
+FdType WebServer::getFdType(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _fdTable.size())
+		return FD_NONE;
+	return _fdTable[fd].type;
+}
+
+Connection *WebServer::getFdConnection(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _fdTable.size())
+		return NULL;
+	return _fdTable[fd].conn;
+}
+
+void WebServer::armTimer(Connection *conn, TimerKind kind)
+{
+	time_t deadline = time(NULL) + getTimeout(kind);
+	if (deadline == conn->getTimerDeadline())
+		return; // most events land in the same second, don't touch the set
+	disarmTimer(conn);
+	_timers.insert(std::make_pair(deadline, conn->getFd()));
+	conn->setTimerDeadline(deadline);
+}
+
+void WebServer::disarmTimer(Connection *conn)
+{
+	if (conn->getTimerDeadline() == 0)
+		return;
+	_timers.erase(std::make_pair(conn->getTimerDeadline(), conn->getFd()));
+	conn->setTimerDeadline(0);
+}
+
+// epoll_wait() timeout in milliseconds until the next deadline, -1 if there is none
+int WebServer::nextTimerTimeout() const
+{
+	if (_timers.empty())
+		return -1;
+	time_t now = time(NULL);
+	time_t deadline = _timers.begin()->first;
+	if (deadline < now)
+		return 0;
+	// A connection expires once the deadline second is over
+	return static_cast<int>(deadline - now + 1) * 1000;
+}
+
 void WebServer::closeExpiredConnections()
 {
 	time_t current_time = time(NULL);
@@ -1910,46 +2871,56 @@ void WebServer::closeExpiredConnections()
 		return;
 	}
 
-	std::vector<int> timed_out_fds;
-
-	// If we delete connections from the map while iterating over it, it will invalidate the iterator
-	// so we first collect all timed out connections and then close them.
-	for (std::map<int, Connection *>::iterator it = _connections.begin();
-		 it != _connections.end(); ++it)
-	{
-		if (current_time - it->second->getLastActivityTime() > _clientTimeout)
-		{
-			timed_out_fds.push_back(it->first);
-		}
-	}
-
-	// Then close them
-	for (std::vector<int>::iterator it = timed_out_fds.begin();
-		 it != timed_out_fds.end(); ++it)
+	// The timers are ordered by deadline, only the expired ones are visited
+	while (!_timers.empty() && _timers.begin()->first < current_time)
 	{
-		std::cout << "Connection timeout on fd " << *it << std::endl;
-		handleConnectionClose(*it);
+		int fd = _timers.begin()->second;
+		std::cout << "Connection timeout on fd " << fd << std::endl;
+		if (getFdType(fd) == FD_CLIENT)
+			handleConnectionClose(fd);
+		else
+			_timers.erase(_timers.begin()); // should not happen, don't loop forever
 	}
 }
 
 void WebServer::run()
+{
+	if (_workerProcesses > 1)
+		this->runMaster();
+	else
+		this->runWorker();
+}
+
+void WebServer::runWorker()
 {
 	this->setupListenerSockets();
-	this->initEpoll();
+	this->initEvents();
+	_evlist.resize(_eventsPerWakeup);
+	// Filled per worker, descriptors opened by one process are never shared
+	_openFileCache.configure(_openFileCacheMax, _openFileCacheValid, _openFileCacheErrors);
+	_responseCache.configure(_responseCacheSize, _responseCacheMaxFileSize);
 
 	// Main loop
 	while (g_running) // initialized to true at header file, until a signal is received
 	{
-		int ready = epoll_wait(this->_epfd, _evlist, kMaxEvents, -1);
+		// Sleep until the next event or the next connection deadline
+		int ready = _events->wait(&_evlist[0], _evlist.size(), nextTimerTimeout());
 		if (ready == -1)
 		{
-			perror("epoll_wait");
+			perror(_events->getName());
 			continue;
 			// TODO: how to handle EINTR? in case of SIGCHLD after fork
 			// when child process is terminated and parent registered signal handler on SIGCHLD
 		}
+		refreshDateHeader(time(NULL)); // one clock read per wakeup, shared by every response
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
 		closeExpiredConnections();
 		processPollEvents(ready);
+		// A slow round means clients are waiting, compression pauses until the loop catches up
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		_deflatePool.setLoopLag((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000);
 
 		// reap every dead child
 		for (;;)
@@ -1960,6 +2931,154 @@ void WebServer::run()
 			_cgiPids.erase(pid);
 		}
 	}
+	if (_responseCache.isEnabled())
+	{
+		std::cout << "response cache: " << _responseCache.getHits() << " hits, "
+				  << _responseCache.getMisses() << " misses, "
+				  << _responseCache.getEvictions() << " evictions, "
+				  << _responseCache.getInvalidations() << " invalidations" << std::endl;
+	}
+	if (_deflatePool.getCompressed() > 0 || _deflatePool.getSkipped() > 0)
+	{
+		std::cout << "gzip: " << _deflatePool.getCompressed() << " compressed, "
+				  << _deflatePool.getSkipped() << " sent uncompressed under load" << std::endl;
+	}
+}
+
+/**
+ * Forks a new worker process.
+ * Returns 0 in the worker, the worker PID in the master, and throws if fork fails.
+ * The worker dies with the master (PR_SET_PDEATHSIG), so it never outlives it.
+ */
+pid_t WebServer::spawnWorker()
+{
+	pid_t masterPid = getpid();
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		int err = errno;
+		throw std::runtime_error("fork worker: " + std::string(strerror(err)));
+	}
+	else if (pid == 0) // Worker process
+	{
+		_workers.clear();
+		if (prctl(PR_SET_PDEATHSIG, SIGTERM) == -1)
+			perror("prctl");
+		if (getppid() != masterPid) // master already gone
+			g_running = false;
+		return 0;
+	}
+	_workers[pid] = time(NULL);
+	std::cout << "worker process " << pid << " started" << std::endl;
+	return pid;
+}
+
+/**
+ * The master process only supervises the workers: it restarts the ones that
+ * die and forwards the shutdown to them once a signal is received.
+ * Each worker owns its own event backend instance and SO_REUSEPORT listener sockets.
+ */
+void WebServer::runMaster()
+{
+	std::cout << "master process " << getpid() << ": starting " << _workerProcesses << " workers" << std::endl;
+	try
+	{
+		for (int i = 0; i < _workerProcesses; ++i)
+		{
+			if (spawnWorker() == 0)
+			{
+				this->runWorker();
+				return;
+			}
+		}
+
+		while (g_running && !_workers.empty())
+		{
+			int status;
+			pid_t pid = waitpid(-1, &status, 0);
+			if (pid == -1)
+			{
+				if (errno == EINTR) // signal received, g_running is checked by the loop
+					continue;
+				perror("waitpid");
+				break;
+			}
+			std::map<pid_t, time_t>::iterator it = _workers.find(pid);
+			if (it == _workers.end())
+				continue;
+			time_t uptime = time(NULL) - it->second;
+			_workers.erase(it);
+			if (!g_running)
+				break;
+
+			if (WIFSIGNALED(status))
+				std::cerr << "worker process " << pid << " killed by signal " << WTERMSIG(status) << std::endl;
+			else
+				std::cerr << "worker process " << pid << " exited with status " << WEXITSTATUS(status) << std::endl;
+
+			// A worker that can't even start (e.g. bind error) would fail again, give up
+			if (uptime < kWorkerMinUptime && WIFEXITED(status) && WEXITSTATUS(status) != 0)
+				throw std::runtime_error("worker process failed on startup");
+
+			if (spawnWorker() == 0)
+			{
+				this->runWorker();
+				return;
+			}
+		}
+	}
+	catch (...)
+	{
+		// Don't leave orphan workers behind, in a worker _workers is empty
+		terminateWorkerProcesses(true);
+		if (!waitForWorkerProcesses(1000))
+			terminateWorkerProcesses(false);
+		throw;
+	}
+
+	// Graceful shutdown of the workers
+	terminateWorkerProcesses(true);
+	if (!waitForWorkerProcesses(1000))
+	{
+		terminateWorkerProcesses(false);
+		waitForWorkerProcesses(500);
+	}
+}
+
+void WebServer::terminateWorkerProcesses(bool graceful)
+{
+	for (std::map<pid_t, time_t>::iterator it = _workers.begin(); it != _workers.end(); ++it)
+	{
+		if (kill(it->first, graceful ? SIGTERM : SIGKILL) == -1 && errno != ESRCH)
+		{
+			if (DEBUG)
+				std::cerr << it->first << ": kill " << (graceful ? "SIGTERM" : "SIGKILL") << ": " << strerror(errno) << std::endl;
+		}
+	}
+}
+
+bool WebServer::waitForWorkerProcesses(int timeoutMs, int checkIntervalMs)
+{
+	int elapsedMs = 0;
+
+	while (!_workers.empty() && elapsedMs < timeoutMs)
+	{
+		for (std::map<pid_t, time_t>::iterator it = _workers.begin(); it != _workers.end();)
+		{
+			int status;
+			pid_t result = waitpid(it->first, &status, WNOHANG);
+			if (result == 0)
+				++it;
+			else
+				_workers.erase(it++);
+		}
+		if (!_workers.empty())
+		{
+			usleep(checkIntervalMs * 1000);
+			elapsedMs += checkIntervalMs;
+		}
+	}
+	return _workers.empty();
 }
 
 void WebServer::registerCgiProcess(pid_t pid)
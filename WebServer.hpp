@@ -2,15 +2,48 @@
 
 #include <map>
 #include <set>
+#include <vector>
 #include <sys/epoll.h>
 #include "Consts.hpp"
 #include "ServerKey.hpp"
+#include "EventBackend.hpp"
+#include "OpenFileCache.hpp"
+#include "ResponseCache.hpp"
+#include "DeflatePool.hpp"
+#include "FastCgiPool.hpp"
+#include "VirtualHostTable.hpp"
 
 class Server;
 class Location;
 class Connection;
 
-const int kMaxEvents = 10;
+// Which phase of the connection a timeout applies to
+enum TimerKind
+{
+	T_HEADER,	 // reading the request line and headers
+	T_BODY,		 // reading the request body
+	T_SEND,		 // sending the response
+	T_KEEPALIVE, // idle between two requests
+	T_CGI,		 // waiting for the CGI process
+	T_KINDS_COUNT
+};
+
+// What a file descriptor watched by epoll belongs to
+enum FdType
+{
+	FD_NONE,
+	FD_LISTENER,
+	FD_CLIENT,
+	FD_CGI_PIPE,
+	FD_FASTCGI // socket to a FastCGI backend, shared by clients
+};
+
+// Entry of the fd-indexed dispatch table
+struct FdSlot
+{
+	FdType type;
+	Connection *conn; // owner of FD_CLIENT and FD_CGI_PIPE descriptors
+};
 
 enum ParseState
 {
@@ -39,6 +72,11 @@ public:
 	int getClientTimeout() const;
 	bool isClientTimeoutSet() const;
 
+	// Per phase timeouts, they default to client_timeout
+	void setTimeout(TimerKind kind, int timeout);
+	int getTimeout(TimerKind kind) const;
+	bool isTimeoutSet(TimerKind kind) const;
+
 	// Convert a size string (e.g., "1k", "2m") to bytes.
 	// possible suffixes: k, K, m, M or none (bytes)
 	void setClientHeaderBufferSize(const std::string &size);
@@ -50,27 +88,94 @@ public:
 	size_t getClientMaxBodySize() const;
 	bool isClientMaxBodySizeSet() const;
 
+	void setWorkerProcesses(int workers);
+	int getWorkerProcesses() const;
+	bool isWorkerProcessesSet() const;
+	void setMultiAccept(int count);
+	int getMultiAccept() const;
+	bool isMultiAcceptSet() const;
+	void setConnectionPool(int count);
+	int getConnectionPool() const;
+	bool isConnectionPoolSet() const;
+	void setEventsPerWakeup(int count);
+	int getEventsPerWakeup() const;
+	bool isEventsPerWakeupSet() const;
+	void setEdgeTriggered(bool edgeTriggered);
+	bool isEdgeTriggered() const;
+	bool isEventModeSet() const;
+	void setEventBackend(const std::string &backend);
+	const std::string &getEventBackend() const;
+	bool isEventBackendSet() const;
+
+	void setOpenFileCache(int maxEntries);
+	bool isOpenFileCacheSet() const;
+	void setOpenFileCacheValid(int seconds);
+	bool isOpenFileCacheValidSet() const;
+	void setOpenFileCacheErrors(bool cacheErrors);
+	bool isOpenFileCacheErrorsSet() const;
+	OpenFileCache &getOpenFileCache();
+	// possible suffixes: k, K, m, M or none (bytes)
+	void setResponseCache(const std::string &size);
+	bool isResponseCacheSet() const;
+	void setResponseCacheMaxFileSize(const std::string &size);
+	bool isResponseCacheMaxFileSizeSet() const;
+	ResponseCache &getResponseCache();
+	DeflatePool &getDeflatePool();
+	FastCgiPool &getFastCgiPool();
+	VirtualHostTable &getVirtualHosts();
+
 	const std::map<ServerKey, Server *> &getServers() const;
 
 private:
 	std::string _fileName;
-	int _epfd;
+	EventBackend *_events; // epoll or io_uring
 	std::map<int, std::pair<std::string, std::string> > _listeners; // key: file descriptor, value: pair of local host and port
 	int _clientTimeout;											   // in seconds; Default: 75
 	bool _clientTimeoutSet;
+	int _timeouts[T_KINDS_COUNT]; // in seconds; Default: client_timeout
+	bool _timeoutsSet[T_KINDS_COUNT];
 	int _clientHeaderBufferSize; // in bytes; Default: 2k
 	bool _clientHeaderBufferSizeSet;
 	size_t _clientMaxBodySize; // in bytes; Default: 1m
 	bool _clientMaxBodySizeSet;
-	struct epoll_event _evlist[kMaxEvents];
+	int _workerProcesses; // Default: 1 (no master process)
+	bool _workerProcessesSet;
+	int _multiAccept; // Default: 32
+	bool _multiAcceptSet;
+	int _connectionPool; // Default: 256
+	bool _connectionPoolSet;
+	int _eventsPerWakeup; // Default: 512
+	bool _eventsPerWakeupSet;
+	bool _edgeTriggered; // Default: false (level-triggered)
+	bool _eventModeSet;
+	std::string _eventBackend; // Default: epoll
+	bool _eventBackendSet;
+	int _openFileCacheMax; // Default: 0 (off)
+	bool _openFileCacheMaxSet;
+	int _openFileCacheValid; // in seconds; Default: 60
+	bool _openFileCacheValidSet;
+	bool _openFileCacheErrors; // Default: false
+	bool _openFileCacheErrorsSet;
+	OpenFileCache _openFileCache; // configured in each worker
+	size_t _responseCacheSize;	  // in bytes; Default: 0 (off)
+	bool _responseCacheSizeSet;
+	size_t _responseCacheMaxFileSize; // in bytes; Default: 64k
+	bool _responseCacheMaxFileSizeSet;
+	ResponseCache _responseCache; // configured in each worker
+	DeflatePool _deflatePool;	  // deflate streams and load state of this worker
+	FastCgiPool _fastCgiPool;	  // backend connections of this worker
+	VirtualHostTable _virtualHosts; // _servers hashed by address, port and name
+	std::vector<struct epoll_event> _evlist; // sized to _eventsPerWakeup
 	std::map<ServerKey, Server *> _servers;
-	std::map<int, Connection *> _connections; // key: file descriptor, value: Connection object
-	std::map<int, Connection *> _pipes;	// key: file descriptor, value: Connection object
+	std::vector<FdSlot> _fdTable; // index: file descriptor (clients, CGI pipes and FastCGI sockets)
+	std::vector<Connection *> _freeConnections; // detached connections, at most _connectionPool
 	std::set<int> _cgiPids;	// set of CGI process PIDs
+	std::set<std::pair<time_t, int> > _timers; // ordered by deadline, value: client file descriptor
+	std::map<pid_t, time_t> _workers; // key: worker process PID, value: start time (master only)
 
 	void parseConfig();
-	void initEpoll();
-	void cleanupEpoll();
+	void initEvents();
+	void cleanupEvents();
 	std::string readUntilDelimiter(std::istream &file, const std::string &delimiters);
 	void handleOpenBracket(const std::string &content_block, Server *&curr_server, Location *&curr_location, ParseState &state);
 	void handleDirective(const std::string &content_block, Server *curr_server, Location *curr_location, ParseState &state);
@@ -79,28 +184,58 @@ private:
 	void validateSizeFormat(const std::string &size);
 	void handle_cgi_bin_directive(const std::vector<std::string> &words, Server *curr_server);
 	void validateUrl(const std::string &url) const;
+	void validateFastcgiPass(const std::string &address) const;
 	void validateReturnDirective(const std::vector<std::string> &words);
 	void validateRootDirective(const std::vector<std::string> &words);
+	void parseExpiresDirective(const std::vector<std::string> &words, ExpiresMode &mode, long &seconds);
 	void handleGlobalDirective(const std::vector<std::string> &words);
 	void handleServerDirective(const std::vector<std::string> &words, Server *curr_server);
 	void handleLocationDirective(const std::vector<std::string> &words, Location *curr_location);
 	void inheritServerDirectives(Server *curr_server);
 	void addServer(Server *server);
 	void processPollEvents(int ready);
-	bool updateEpollEvents(int fd, uint32_t events);
-	bool addEpollEvents(int fd, uint32_t events);
+	bool updateEvents(int fd, uint32_t events);
+	bool addEvents(int fd, uint32_t events);
 	void closeListenerSockets();
 	void cleanupServers();
 	void cleanupConnections();
+	Connection *acquireConnection(int fd, const std::string &port, const std::string &host,
+								  const std::string &remotePort, const std::string &remoteHost);
+	void releaseConnection(Connection *conn);
+	void trimConnectionPool(size_t keep);
 	void cleanupPipes();
 	void handleConnectionClose(int fd);
 	void setupListenerSockets();
 	void handleNewConnection(int listener);
-	void handleClientRecv(int fd);
-	void handleClientSend(int fd);
+	bool acceptConnection(int listener);
+	bool handleClientRecv(int fd);
+	bool handleClientSend(int fd);
+	bool startResponse(int fd, Connection *conn, RequestState state);
+	void armRequestTimer(Connection *conn);
+	void handleClientEdge(int fd);
+	void resumeClientAfterCgi(Connection *conn);
 	void handleCgiRecv(int fd);
 	void finalizeCgiRecv(int fd);
 	void handleCgiSend(int fd);
+	bool startFastCgi(Connection *conn);
+	void handleFastCgiEvent(int fd, uint32_t events);
+	void syncFastCgiEvents(int fd);
+
+	// connection timers
+	void armTimer(Connection *conn, TimerKind kind);
+	void disarmTimer(Connection *conn);
+	int nextTimerTimeout() const;
+	void setFdSlot(int fd, FdType type, Connection *conn);
+	void clearFdSlot(int fd);
+	FdType getFdType(int fd) const;
+	Connection *getFdConnection(int fd) const;
+
+	// master / worker processes
+	void runMaster();
+	void runWorker();
+	pid_t spawnWorker();
+	void terminateWorkerProcesses(bool graceful = true);
+	bool waitForWorkerProcesses(int timeoutMs, int checkIntervalMs = 50);
 
 	//methods for CGI process shutdown
 	void terminateCgiProcesses(bool graceful = true);
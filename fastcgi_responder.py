@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""
+Stand-in FastCGI responder to try fastcgi_pass without PHP-FPM.
+
+	./fastcgi_responder.py 127.0.0.1:9000
+	./fastcgi_responder.py unix:/tmp/webserv-fcgi.sock
+
+Keeps the connections open (FCGI_KEEP_CONN), accepts several requests on
+one of them (FCGI_MPXS_CONNS) and answers each with the params it received
+and its body. "?sleep=<seconds>" delays the answer, "?size=<bytes>" sends
+a body of that size instead.
+"""
+import os
+import selectors
+import socket
+import struct
+import sys
+import time
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_STDERR = 7
+FCGI_GET_VALUES = 9
+FCGI_GET_VALUES_RESULT = 10
+FCGI_UNKNOWN_TYPE = 11
+FCGI_KEEP_CONN = 1
+FCGI_REQUEST_COMPLETE = 0
+FCGI_UNKNOWN_ROLE = 3
+FCGI_RESPONDER = 1
+
+selector = selectors.DefaultSelector()
+delayed = []  # (time, connection, request id)
+
+
+def record(rtype, request_id, content=b""):
+	"""Records of at most 65535 bytes, padded to a multiple of 8."""
+	out = b""
+	while True:
+		chunk, content = content[:65535], content[65535:]
+		padding = -len(chunk) % 8
+		out += struct.pack(">BBHHBx", 1, rtype, request_id, len(chunk), padding) + chunk + b"\0" * padding
+		if not content:
+			return out
+
+
+def parse_pairs(data):
+	pairs = {}
+	i = 0
+	while i < len(data):
+		lengths = []
+		for _ in range(2):
+			if data[i] & 0x80:
+				lengths.append(struct.unpack(">I", data[i:i + 4])[0] & 0x7fffffff)
+				i += 4
+			else:
+				lengths.append(data[i])
+				i += 1
+		name = data[i:i + lengths[0]]
+		i += lengths[0]
+		pairs[name.decode("latin-1")] = data[i:i + lengths[1]].decode("latin-1")
+		i += lengths[1]
+	return pairs
+
+
+def encode_pairs(pairs):
+	out = b""
+	for name, value in pairs.items():
+		for item in (name, value):
+			out += bytes([len(item)]) if len(item) < 128 else struct.pack(">I", len(item) | 0x80000000)
+		out += name.encode() + value.encode()
+	return out
+
+
+class Connection:
+	def __init__(self, sock):
+		self.sock = sock
+		self.input = b""
+		self.output = b""
+		self.requests = {}  # id: {"keep": bool, "params": bytes, "stdin": bytes}
+		self.closing = False
+
+	def send(self, data):
+		self.output += data
+		self.flush()
+
+	def flush(self):
+		try:
+			while self.output:
+				sent = self.sock.send(self.output)
+				self.output = self.output[sent:]
+		except BlockingIOError:
+			pass
+		except OSError:
+			self.close()
+			return
+		events = selectors.EVENT_READ | (selectors.EVENT_WRITE if self.output else 0)
+		selector.modify(self.sock, events, self)
+		if self.closing and not self.output:
+			self.close()
+
+	def close(self):
+		try:
+			selector.unregister(self.sock)
+		except (KeyError, ValueError):
+			pass
+		self.sock.close()
+
+	def receive(self):
+		try:
+			data = self.sock.recv(65536)
+		except BlockingIOError:
+			return
+		except OSError:
+			data = b""
+		if not data:
+			self.close()
+			return
+		self.input += data
+		while len(self.input) >= 8:
+			_, rtype, request_id, length, padding = struct.unpack(">BBHHBx", self.input[:8])
+			if len(self.input) < 8 + length + padding:
+				break
+			content = self.input[8:8 + length]
+			self.input = self.input[8 + length + padding:]
+			self.handle(rtype, request_id, content)
+
+	def handle(self, rtype, request_id, content):
+		if request_id == 0:
+			if rtype == FCGI_GET_VALUES:
+				values = {"FCGI_MAX_CONNS": "100", "FCGI_MAX_REQS": "1000", "FCGI_MPXS_CONNS": "1"}
+				self.send(record(FCGI_GET_VALUES_RESULT, 0, encode_pairs(values)))
+			else:
+				self.send(record(FCGI_UNKNOWN_TYPE, 0, bytes([rtype]) + b"\0" * 7))
+			return
+		if rtype == FCGI_BEGIN_REQUEST:
+			role, flags = struct.unpack(">HB", content[:3])
+			if role != FCGI_RESPONDER:
+				self.send(record(FCGI_END_REQUEST, request_id, struct.pack(">IB3x", 0, FCGI_UNKNOWN_ROLE)))
+				return
+			self.requests[request_id] = {"keep": bool(flags & FCGI_KEEP_CONN), "params": b"", "stdin": b""}
+			return
+		request = self.requests.get(request_id)
+		if request is None:
+			return
+		if rtype == FCGI_PARAMS:
+			request["params"] += content
+		elif rtype == FCGI_STDIN:
+			if content:
+				request["stdin"] += content
+				return
+			params = parse_pairs(request["params"])
+			query = dict(p.split("=", 1) for p in params.get("QUERY_STRING", "").split("&") if "=" in p)
+			if "sleep" in query:
+				delayed.append((time.time() + float(query["sleep"]), self, request_id))
+			else:
+				self.respond(request_id)
+
+	def respond(self, request_id):
+		request = self.requests.pop(request_id, None)
+		if request is None or self.sock.fileno() == -1:
+			return
+		params = parse_pairs(request["params"])
+		query = dict(p.split("=", 1) for p in params.get("QUERY_STRING", "").split("&") if "=" in p)
+		if "size" in query:
+			body = b"x" * int(query["size"])
+		else:
+			lines = ["pid: %d" % os.getpid(), "request id: %d" % request_id]
+			lines += ["%s=%s" % (name, params[name]) for name in sorted(params)]
+			body = ("\n".join(lines) + "\n").encode() + request["stdin"]
+		head = b"Status: 200 OK\r\nContent-Type: text/plain\r\n\r\n"
+		self.send(record(FCGI_STDOUT, request_id, head + body)
+				  + record(FCGI_STDOUT, request_id)
+				  + record(FCGI_END_REQUEST, request_id, struct.pack(">IB3x", 0, FCGI_REQUEST_COMPLETE)))
+		if not request["keep"]:
+			self.closing = True
+			self.flush()
+
+
+def listen(address):
+	if address.startswith("unix:"):
+		path = address[5:]
+		if os.path.exists(path):
+			os.unlink(path)
+		sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+		sock.bind(path)
+	else:
+		host, port = address.rsplit(":", 1)
+		host = host.strip("[]")
+		sock = socket.socket(socket.AF_INET6 if ":" in host else socket.AF_INET, socket.SOCK_STREAM)
+		sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+		sock.bind((host, int(port)))
+	sock.listen(128)
+	sock.setblocking(False)
+	return sock
+
+
+def main():
+	if len(sys.argv) != 2:
+		sys.stderr.write("usage: %s unix:/path | host:port\n" % sys.argv[0])
+		sys.exit(1)
+	listener = listen(sys.argv[1])
+	selector.register(listener, selectors.EVENT_READ, None)
+	while True:
+		timeout = None
+		if delayed:
+			timeout = max(0, min(d[0] for d in delayed) - time.time())
+		for key, events in selector.select(timeout):
+			if key.data is None:
+				try:
+					sock, _ = listener.accept()
+				except BlockingIOError:
+					continue
+				sock.setblocking(False)
+				selector.register(sock, selectors.EVENT_READ, Connection(sock))
+			elif events & selectors.EVENT_READ:
+				key.data.receive()
+			elif events & selectors.EVENT_WRITE:
+				key.data.flush()
+		now = time.time()
+		for due in [d for d in delayed if d[0] <= now]:
+			delayed.remove(due)
+			due[1].respond(due[2])
+
+
+if __name__ == "__main__":
+	try:
+		main()
+	except KeyboardInterrupt:
+		pass